@@ -4,279 +4,1184 @@
 
 #include "AudioEx.h"
 #include <stdint.h>
+#include <algorithm>
 
-Float32 Ino(Float32 x)
+template <class PROFILE>
+constexpr typename AudioExT<PROFILE>::GFT_TABLES AudioExT<PROFILE>::gft_tables(double rate)
 {
-    Float32 d = 0.0, ds = 1.0, s = 1.0;
-    do
+    GFT_TABLES tables = {};
+    
+    // windowing (Kaiser-Bessel) function
+    const double alpha = 2.5;
+    double den = Ino(M_PI * alpha);
+    int n1 = SAMPLING_LENGTH/2;
+    int n2 = n1*n1;
+    tables.window[0] = 0.0;
+    tables.window[2*n1] = 0.0;
+    tables.window[n1] = 2.0;
+    for (int i=1; i<n1; i++)
+    {
+        double t = Ino(M_PI*alpha*const_sqrt(1.0-(double)i*i/n2));
+        tables.window[n1+i] = 2.0 * t / den;
+        tables.window[n1-i] = tables.window[n1+i];
+    }
+    
+    // freq bins, channel by channel
+    for (int i=0; i<CHANNEL_COUNT*FREQ_COUNT; i++)
+    {
+        double freq = PROFILE::signal_freqs[i % FREQ_COUNT] + (i / FREQ_COUNT) * CHANNEL_SPACING;
+        tables.cosine[i] = 2.0 * const_cos(2.0 * M_PI * freq / rate); // real part
+        tables.sine[i] = const_sin(2.0 * M_PI * freq / rate); // imag part
+    }
+    
+#ifdef HETERODYNE_ENABLED
+    // heterodyne front end, band center mixed down to DC with windowing folded into the local oscillator
+    // channels are shifted copies of the band, only their oscillators differ
+    double center = (PROFILE::signal_freqs[0] + PROFILE::signal_freqs[FREQ_COUNT-1]) / 2.0;
+    for (int c=0; c<CHANNEL_COUNT; c++)
+    {
+        double lo = center + c * CHANNEL_SPACING;
+        for (int i=0; i<SAMPLING_LENGTH; i++)
+        {
+            tables.lo_re[c][i] = tables.window[i] * const_cos(2.0 * M_PI * lo * i / rate);
+            tables.lo_im[c][i] = -tables.window[i] * const_sin(2.0 * M_PI * lo * i / rate);
+        }
+    }
+    // decimated freq bins, scaled by the inverse of the CIC droop and decimation gain
+    for (int i=0; i<FREQ_COUNT; i++)
+    {
+        double w = 2.0 * M_PI * (PROFILE::signal_freqs[i] - center) / rate;
+        double droop = w != 0.0 ? const_sin(HETERODYNE_DECIMATION * w / 2.0) / (HETERODYNE_DECIMATION * const_sin(w / 2.0)) : 1.0;
+        tables.hd_cosine[i] = 2.0 * const_cos(w * HETERODYNE_DECIMATION);
+        tables.hd_sine[i] = const_sin(w * HETERODYNE_DECIMATION);
+        tables.hd_scale[i] = 1.0 / (HETERODYNE_DECIMATION * droop * droop);
+    }
+#endif
+    
+#ifdef PREAMBLE_ENABLED
+    // start pair correlator, the band between the start tones to DC, the oscillator runs on from block to block
+    double pa_center = (PROFILE::signal_freqs[PROFILE::CW_ST0[0]] + PROFILE::signal_freqs[PROFILE::CW_ST0[1]]) / 2.0;
+    for (int c=0; c<CHANNEL_COUNT; c++)
+    {
+        double lo = pa_center + c * CHANNEL_SPACING;
+        for (int i=0; i<SAMPLING_LENGTH; i++)
+        {
+            tables.pa_lo_re[c][i] = const_cos(2.0 * M_PI * lo * i / rate);
+            tables.pa_lo_im[c][i] = -const_sin(2.0 * M_PI * lo * i / rate);
+        }
+        tables.pa_step[c][0] = const_cos(2.0 * M_PI * lo * SAMPLING_LENGTH / rate);
+        tables.pa_step[c][1] = -const_sin(2.0 * M_PI * lo * SAMPLING_LENGTH / rate);
+    }
+    for (int i=0; i<PREAMBLE_FFT_LEN/2; i++)
+    {
+        tables.pa_twiddle_re[i] = const_cos(2.0 * M_PI * i / PREAMBLE_FFT_LEN);
+        tables.pa_twiddle_im[i] = -const_sin(2.0 * M_PI * i / PREAMBLE_FFT_LEN);
+    }
+    // segment of each start tone at the decimated rate, its spectrum is a geometric series at every bin
+    for (int k=0; k<2; k++)
+    {
+        double w = 2.0 * M_PI * (PROFILE::signal_freqs[PROFILE::CW_ST0[k]] - pa_center) * PREAMBLE_DECIMATION / rate;
+        for (int m=0; m<PREAMBLE_FFT_LEN; m++)
+        {
+            double phi = w - 2.0 * M_PI * m / PREAMBLE_FFT_LEN;
+            double s = const_sin(phi / 2.0);
+            double a = s > -1e-12 && s < 1e-12 ? (double)PREAMBLE_SEGMENT : const_sin(PREAMBLE_SEGMENT * phi / 2.0) / s;
+            double arg = phi * (PREAMBLE_SEGMENT - 1) / 2.0;
+            tables.pa_template_re[k][m] = a * const_cos(arg) / PREAMBLE_FFT_LEN;
+            tables.pa_template_im[k][m] = -a * const_sin(arg) / PREAMBLE_FFT_LEN;
+        }
+    }
+    for (int s=0; s<SIGNAL_FRAMES; s++)
+    {
+        double e = const_sin(M_PI * (s + 0.5) / SIGNAL_FRAMES);
+        tables.pa_envelope[s] = e * e;
+    }
+#endif
+    
+#ifdef FIXED_POINT_ENABLED
+    // fixed-point copies, rounded and saturated
+    for (int i=0; i<SAMPLING_LENGTH; i++)
+    {
+        double w = tables.window[i] / 2.0 * 32768.0 + 0.5;
+        tables.window_q15[i] = (int16_t)(w >= 32767.0 ? 32767 : (int)w);
+    }
+    for (int i=0; i<CHANNEL_COUNT*FREQ_COUNT; i++)
     {
-        d += 2.0;
-        ds *= x * x / (d * d);
-        s += ds;
+        tables.cosine_q30[i] = const_q30(2.0 * const_cos(2.0 * M_PI * (PROFILE::signal_freqs[i % FREQ_COUNT] + (i / FREQ_COUNT) * CHANNEL_SPACING) / rate));
     }
-    while (ds > s * 1e-6);
-    return s;
+#endif
+    
+    return tables;
 }
 
-AudioEx::AudioEx(float sampleRate)
+template <class PROFILE>
+constexpr typename AudioExT<PROFILE>::GFT_TABLES AudioExT<PROFILE>::PROTOCOL_GFT_TABLES = AudioExT<PROFILE>::gft_tables(PROTOCOL_SAMPLE_RATE);
+
+template <class PROFILE>
+AudioExT<PROFILE>::AudioExT(float sampleRate)
 {
     // initialize globals
+    capture_rate = sampleRate;
     sample_rate = sampleRate;
-    result = 0;
-    rx_level = 0.0;
+    lane = false;
+    
+    // resample other capture rates to the protocol rate
+    resampler_init((int)(sampleRate + 0.5), PROTOCOL_SAMPLE_RATE);
+    if (resampler.up > 0) sample_rate = PROTOCOL_SAMPLE_RATE;
+    
+    detectors_init();
     
     LOG({
         printf("SIGNAL LENGTH: %.02fms (%.0fms)\n", (float)SIGNAL_GENERATOR_LEN * 1000.0f / sample_rate, (float)SIGNAL_GENERATOR_LEN * 1000.0f / sample_rate * FULL_SIGNAL_LEN);
         printf("DFT RESOLUTION: %.02fHz\n", sample_rate/SAMPLING_LENGTH);
     });
     
-    // initialize signal generator
-    signal_generator_reset();
+#ifdef PREAMBLE_ENABLED
+    preambles = (PREAMBLE_CORRELATOR *)calloc(CHANNEL_COUNT, sizeof(PREAMBLE_CORRELATOR));
+    for (int c=0; c<CHANNEL_COUNT; c++) preambles[c].lo[0] = 1.0;
+#endif
+#ifdef ECHO_CANCEL_ENABLED
+    echo = (ECHO_CANCELLER *)calloc(1, sizeof(ECHO_CANCELLER));
+#endif
+#ifdef DECODE_QUEUE_ENABLED
+    decodes = (DECODE_QUEUE *)calloc(1, sizeof(DECODE_QUEUE));
+#endif
     
-    // freq bins
-    for (int i=0; i<FREQ_COUNT; i++)
+    LOG({
+        printf("DETECTOR STATE: %i bytes\n", (int)sizeof(DETECTOR_STATE));
+    });
+    
+    // window and freq bin tables, computed only for rates the resampler can't convert to the protocol rate
+    if (sample_rate != PROTOCOL_SAMPLE_RATE)
     {
-        gft_coeff_cosine[i] = 2.0 * cosf(2.0 * M_PI * signal_freqs[i] / sample_rate); // real part
-        gft_coeff_sine[i] = sinf(2.0 * M_PI * signal_freqs[i] / sample_rate); // imag part
+        custom_tables = (GFT_TABLES *)malloc(sizeof(GFT_TABLES));
+        *custom_tables = gft_tables(sample_rate);
+        tables = custom_tables;
     }
     
     // initialize RS(15, 11) codec
     rs_codec = init_rs_char(RS_SYMSIZE, RS_POLY, 1, 1, RS_PARITY);
+}
+
+template <class PROFILE>
+AudioExT<PROFILE>::AudioExT(void *codec)
+{
+    // batch lane at the protocol rate, fed bins by the batch
+    capture_rate = PROTOCOL_SAMPLE_RATE;
+    sample_rate = PROTOCOL_SAMPLE_RATE;
+    lane = true;
+    resampler_init(PROTOCOL_SAMPLE_RATE, PROTOCOL_SAMPLE_RATE);
+    detectors_init();
+    rs_codec = codec;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::detectors_init()
+{
+    result = 0;
+    result_channel = 0;
+    message_len = 0;
+    message_channel = 0;
+    rx_level = 0.0;
+#ifdef METERING_ENABLED
+    memset(&counters, 0, sizeof counters);
+    memset(&meter, 0, sizeof meter);
+    meter_seq = 0;
+    meter_blocks = 0;
+    meter_wanted = 0;
+    meter_pending = false;
+    meter_rms = 0.0;
+#endif
+    block_len = 0;
     
-    // initialize windowing (Kaiser-Bessel) function
-    const Float32 alpha = 2.5;
-    Float32 den = Ino(M_PI * alpha);
-    int n1 = SAMPLING_LENGTH/2;
-    int n2 = n1*n1;
-    wnd_coeffs[0] = 0.0;
-    wnd_coeffs[n1] = 2.0;
-    for (int i=1; i<n1; i++)
+    set_repeat_window(RECENT_CODES_WINDOW);
+    
+    // initialize signal generator
+    signal_generator.channel = 0;
+    signal_generator.data_len = FULL_SIGNAL_LEN;
+    signal_generator_reset();
+    
+    // initialize detectors
+    memset(detectors, 0, sizeof detectors);
+    memset(receivers, 0, sizeof receivers);
+    for (int c=0; c<CHANNEL_COUNT; c++)
     {
-        Float32 t = Ino(M_PI*alpha*sqrtf(1.0-(Float32)i*i/n2));
-        wnd_coeffs[n1+i] = 2.0 * t / den;
-        wnd_coeffs[n1-i] = wnd_coeffs[n1+i];
+        detectors[c].status = DETECT;
+        for (int m=0; m<MIC_COUNT; m++) detectors[c].mic_weight[m] = 1.0 / MIC_COUNT;
+#ifdef IDLE_GATE_ENABLED
+        for (int k=0; k<2; k++) detectors[c].gate_floor[k] = MIN_PEAK;
+#endif
+#ifdef FREQ_TRACK_ENABLED
+        detectors[c].freq_rot[0] = 1.0;
+        detectors[c].freq_probes = FREQ_TRACK_PROBES;
+#endif
     }
+    detector = &detectors[0];
+    receiver = &receivers[0];
+#ifdef PREAMBLE_ENABLED
+    preambles = NULL;
+    preamble_time = 0.0;
+    preamble_score = 0.0;
+    preamble_channel = 0;
+#endif
+#ifdef ECHO_CANCEL_ENABLED
+    echo = NULL;
+#endif
+#ifdef DECODE_QUEUE_ENABLED
+    decodes = NULL;
+#endif
+    tables = &PROTOCOL_GFT_TABLES;
+    custom_tables = NULL;
 }
 
-int payload_diff(int payload1[], int payload2[])
+static int gcd(int a, int b)
 {
-    int ret = 0;
-    for (int i=0; i<PAYLOAD_LEN; i++) if (payload1[i] != payload2[i]) ret++;
-    return ret;
+    while (b) { int t = a % b; a = b; b = t; }
+    return a;
 }
 
-typedef enum {
-    DETECT = 0,
-    DECODE = 1,
-} DETECTOR_STATUS;
-
-#define CSTEP(pos, len) ((pos) % len)
-
-void AudioEx::detect(Float32 mags[FREQ_COUNT], int phases[FREQ_COUNT])
+template <class PROFILE>
+void AudioExT<PROFILE>::resampler_init(int in_rate, int out_rate)
 {
-    static int fft_frame_i = 0;
-    static int fft_test_i = 0;
+    memset(&resampler, 0, sizeof resampler);
+    if (in_rate == out_rate || in_rate <= 0) return;
     
-    static Float32 fft_mags[FREQ_COUNT][SIGNAL_FRAMES];
-    static Float32 fft_mag_sums[FREQ_COUNT][SIGNAL_FRAMES];
-    static Float32 fft_sum_diffs[FREQ_COUNT][SIGNAL_TEST_FRAME_LEN];
-    static int fft_phases[FREQ_COUNT][SIGNAL_TEST_FRAME_LEN];
-    static Float32 fft_powers[FREQ_COUNT][SIGNAL_TEST_FRAME_LEN];
-    static int fft_max_powers[2][SIGNAL_TEST_FRAME_LEN];
+    int g = gcd(in_rate, out_rate);
+    int up = out_rate / g;
+    int down = in_rate / g;
+    if (up > RESAMPLER_MAX_PHASES)
+    {
+        LOG({
+            printf("[ERROR] unsupported sample rate ratio: %i/%i\n", up, down);
+        });
+        return;
+    }
     
-    static DETECTOR_STATUS status = DETECT;
+    int taps = (int)ceilf(RESAMPLER_TAPS * (down > up ? (Float32)down / up : 1.0));
+    int len = up * taps;
     
-    int p_fft_frame_i = (fft_frame_i > 0 ? fft_frame_i - 1 : SIGNAL_FRAMES - 1);
+    // lowpass at the lower Nyquist rate, normalized to the upsampled rate
+    Float32 cutoff = 0.5 * (in_rate < out_rate ? in_rate : out_rate) / ((Float32)up * in_rate);
+    Float32 den = Ino(RESAMPLER_KAISER_BETA);
     
-    Float32 max_v = INT32_MIN;
-    int max_i = 0;
-#ifdef METERING_ENABLED
-    Float32 sum_v = 0.0;
-#endif
+    resampler.up = up;
+    resampler.down = down;
+    resampler.taps = taps;
+    resampler.coeffs = (Float32 *)malloc(len * sizeof(Float32));
+    resampler.history = (Float32 *)calloc(MIC_COUNT * 2 * taps, sizeof(Float32));
     
-    for (int i=0; i<FREQ_COUNT; i++)
+    for (int i=0; i<len; i++)
     {
-        // squared mag
-        Float32 fft_mag = mags[i];
-        
-        // sums of mags
-        fft_mag_sums[i][fft_frame_i] = fft_mag_sums[i][p_fft_frame_i] - fft_mags[i][fft_frame_i] + fft_mag;
-        fft_mags[i][fft_frame_i] = fft_mag;
-        
-        // sum diffs
-        Float32 fft_sum_diff = fft_mag_sums[i][fft_frame_i] - fft_mag_sums[i][p_fft_frame_i];
-        fft_sum_diffs[i][fft_test_i] = fft_sum_diff;
+        Float32 x = i - (len - 1) / 2.0;
+        Float32 r = 2.0 * i / (len - 1) - 1.0;
+        Float32 sinc = x != 0.0 ? sinf(2.0 * M_PI * cutoff * x) / (M_PI * x) : 2.0 * cutoff;
+        Float32 h = up * sinc * Ino(RESAMPLER_KAISER_BETA * sqrtf(1.0 - r * r)) / den;
         
-        // power = mag + difference of sums
-        Float32 fft_power = fft_mag_sums[i][fft_frame_i] + fft_sum_diff;
-        
-#ifdef METERING_ENABLED
-        // diag, rx_level
-        sum_v += abs(fft_sum_diff);
-#endif
+        // phase = i % up, tap = i / up, reversed so the newest sample meets the last coefficient
+        resampler.coeffs[(i % up) * taps + (taps - 1 - i / up)] = h;
+    }
+    
+    LOG({
+        printf("RESAMPLER: %i -> %iHz (%i/%i, %i taps)\n", in_rate, out_rate, up, down, taps);
+    });
+}
+
+#define PROCESS_FRAME(_x_) { for (int m=0; m<MIC_COUNT; m++) block[m*SAMPLING_LENGTH+block_len] = sample_pack(_x_); if (++block_len == SAMPLING_LENGTH) { gft(block); if (result > 0) decoded = result; if (message_len > 0) decoded_len = message_len; block_len = 0; } }
+
+template <class PROFILE>
+void AudioExT<PROFILE>::process(const Float32 samples[], int count)
+{
+    // count frames of MIC_COUNT interleaved samples
+    unsigned int decoded = 0;
+    int decoded_len = 0;
+    
+    for (int n=0; n<count; n++)
+    {
+        const Float32 *frame = &samples[n*MIC_COUNT];
+        if (resampler.up == 0)
+        {
+            PROCESS_FRAME(frame[m]);
+            continue;
+        }
         
-        // phase
-        fft_phases[i][fft_test_i] = phases[i];
+        // push input samples into the mirrored histories, one per mic
+        resampler.history_i = (resampler.history_i + 1) % resampler.taps;
+        for (int m=0; m<MIC_COUNT; m++)
+        {
+            Float32 *history = &resampler.history[m * 2 * resampler.taps];
+            history[resampler.history_i] = frame[m];
+            history[resampler.history_i + resampler.taps] = frame[m];
+        }
         
+        // output samples at this input position
+        while (resampler.phase < resampler.up)
+        {
+            const Float32 *h = &resampler.coeffs[resampler.phase * resampler.taps];
+            Float32 y[MIC_COUNT];
+            for (int m=0; m<MIC_COUNT; m++)
+            {
+                const Float32 *x = &resampler.history[m * 2 * resampler.taps + resampler.history_i + 1];
+                y[m] = 0.0;
+                for (int i=0; i<resampler.taps; i++) y[m] += h[i] * x[i];
+            }
+            PROCESS_FRAME(y[m]);
+            resampler.phase += resampler.down;
+        }
+        resampler.phase -= resampler.up;
+    }
+    
+    // keep a result or message decoded from any of the blocks
+    result = decoded;
+    message_len = decoded_len;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::set_repeat_window(Float32 seconds)
+{
+    // frames at the protocol rate
+    repeat_window = seconds > 0.0 ? (int)(seconds * sample_rate / SAMPLING_LENGTH + 0.5) : 0;
+}
+
+static int payload_diff(const int payload1[], const int payload2[], int len)
+{
+    int ret = 0;
+    for (int i=0; i<len; i++) if (payload1[i] != payload2[i]) ret++;
+    return ret;
+}
+
+#define CSTEP(pos, len) ((pos) % len)
+#define HSTEP(pos) CSTEP((pos) + HISTORY_LEN, HISTORY_LEN)
+
+#define MAXIMA_1ST(_t_) (detector->maxima[_t_] & 0x0f)
+#define MAXIMA_2ND(_t_) (detector->maxima[_t_] >> 4)
+#define PHASE_CHANGE(_f_, _t_) ((detector->phases[_t_] >> (_f_)) & 1)
+
+template <class PROFILE>
+Float32 AudioExT<PROFILE>::frame_mag(int f, int t)
+{
+    return detector_mag_unpack(detector->mags[f][HSTEP(t)]);
+}
+
+template <class PROFILE>
+DETECTOR_POWER AudioExT<PROFILE>::frame_sum_diff(int f, int t)
+{
+    // difference of sums of mags across SIGNAL_FRAMES frames
+    return detector_mag_power(detector->mags[f][HSTEP(t)]) - detector_mag_power(detector->mags[f][HSTEP(t-SIGNAL_FRAMES)]);
+}
+
+template <class PROFILE>
+DETECTOR_POWER AudioExT<PROFILE>::frame_power(int f, int t)
+{
+    // power = sum of mags + difference of sums
+    DETECTOR_POWER sum = 0;
+    for (int i=0; i<SIGNAL_FRAMES; i++) sum += detector_mag_power(detector->mags[f][HSTEP(t-i)]);
+    return sum + frame_sum_diff(f, t);
+}
+
+template <class PROFILE>
+unsigned char AudioExT<PROFILE>::frame_maxima(int t)
+{
+    DETECTOR_POWER fft_powers[FREQ_COUNT];
+    DETECTOR_POWER max_v = INT32_MIN;
+    int max_i = 0;
+    
+    for (int i=0; i<FREQ_COUNT; i++)
+    {
         // powers
-        fft_powers[i][fft_test_i] = fft_power;
+        fft_powers[i] = frame_power(i, t);
         
         // detect maxima
-        if (fft_power > max_v)
+        if (fft_powers[i] > max_v)
         {
-            max_v = fft_power;
+            max_v = fft_powers[i];
             max_i = i;
         }
     }
     
-#ifdef METERING_ENABLED
-    // diag, rx_level
-#define MAX_V 25.0
-    static Float32 p_rx_level = 0.0;
-    rx_level = sum_v > MAX_V ? 1.0 : sum_v/MAX_V;
-    // decimate level
-    if (rx_level == 1.0 && p_rx_level == 1.0) rx_level -= 0.2;
-    p_rx_level = rx_level;
-#endif
-    
-    // save 1st maxima of power sums
-    fft_max_powers[0][fft_test_i] = max_i;
-    
     // calculate 2nd maxima of power sums
+    int max_1st = max_i;
     max_v = INT32_MIN;
     max_i = 0;
     for (int i=0; i<FREQ_COUNT; i++)
     {
-        if (i == fft_max_powers[0][fft_test_i]) continue;
+        if (i == max_1st) continue;
         
-        if (fft_powers[i][fft_test_i] > max_v)
+        if (fft_powers[i] > max_v)
         {
-            max_v = fft_powers[i][fft_test_i];
+            max_v = fft_powers[i];
             max_i = i;
         }
     }
-    fft_max_powers[1][fft_test_i] = max_i;
     
-    // next frame index
-    fft_frame_i = CSTEP(fft_frame_i+1, SIGNAL_FRAMES);
+    // 1st and 2nd maxima packed as tone index nibbles
+    return (unsigned char)(max_1st | (max_i << 4));
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::detect(const Float32 mags[FREQ_COUNT], PHASE_FLAGS phases)
+{
+    int t = detector->frame_i;
+    
+    detector->clock++;
+    if (detector->sic_hold > 0) detector->sic_hold--;
+    
+#ifdef IDLE_GATE_ENABLED
+    // idle, keep history warm only
+    if (detector->gate_open == 0)
+    {
+        for (int i=0; i<FREQ_COUNT; i++) detector->mags[i][t] = detector_mag_pack(mags[i]);
+        noise_update(mags, (1 << PROFILE::CW_ST0[0]) | (1 << PROFILE::CW_ST0[1]));
+        detector->phases[t] = phases;
+        detector->maxima[t] = (unsigned char)(PROFILE::CW_ST0[0] | (PROFILE::CW_ST0[1] << 4));
+        detector->symbols[HSTEP(t-SIGNAL_FRAMES)] = -1;
+#ifdef METERING_ENABLED
+        rx_level = 0.0;
+        detector->p_rx_level = rx_level;
+#endif
+        detector->frame_i = HSTEP(t+1);
+        if (detector->f_skip > 0) detector->f_skip--;
+        return;
+    }
+#endif
+    
+#ifdef METERING_ENABLED
+    DETECTOR_POWER sum_v = 0;
+#endif
+    
+    for (int i=0; i<FREQ_COUNT; i++)
+    {
+        // squared mag
+        detector->mags[i][t] = detector_mag_pack(mags[i]);
+        
+#ifdef METERING_ENABLED
+        // diag, rx_level
+        DETECTOR_POWER diff = frame_sum_diff(i, t);
+        sum_v += diff < 0 ? -diff : diff;
+#endif
+    }
+    
+    noise_update(mags, (1 << FREQ_COUNT) - 1);
+    
+    // phase
+    detector->phases[t] = phases;
+    
+#ifdef METERING_ENABLED
+    // diag, rx_level
+#define MAX_V 25.0
+    Float32 level = detector_power_unpack(sum_v);
+    rx_level = level > MAX_V ? 1.0 : level/MAX_V;
+    // decimate level
+    if (rx_level == 1.0 && detector->p_rx_level == 1.0) rx_level -= 0.2;
+    detector->p_rx_level = rx_level;
+#endif
+    
+    // save 1st and 2nd maxima of power sums, the slot pair ending here gets its symbol
+    detector->maxima[t] = frame_maxima(t);
+    frame_symbol(t);
     
-    // next test data index
-    fft_test_i = CSTEP(fft_test_i+1, SIGNAL_TEST_FRAME_LEN);
+    // next history index
+    detector->frame_i = HSTEP(t+1);
     
-    // now indexes point to the oldest test data in FIFO buffers
+    // oldest test data in history
+    int fft_test_i = HSTEP(detector->frame_i+SIGNAL_FRAMES);
     
     // should we skip sample frames?
-    static int f_skip = 0;
-    if (f_skip > 0)
+    if (detector->f_skip > 0)
+    {
+        detector->f_skip--;
+        return;
+    }
+    
+#ifdef IDLE_GATE_ENABLED
+    // oldest test frame was not fully evaluated
+    if (detector->gate_open < SIGNAL_TEST_FRAME_LEN) return;
+#endif
+    
+    // message receiving state, frames are consumed as they arrive
+    if (detector->status == RECEIVE)
     {
-        f_skip--;
+        receiver->next--;
+        message_receive(t);
         return;
     }
     
     // detection state
-    if (status == DETECT)
+    if (detector->status == DETECT)
     {
-        // check signal start (ST0)
-        int n_fft_test_i = CSTEP(fft_test_i+SIGNAL_FRAMES, SIGNAL_TEST_FRAME_LEN);
+        // check signal start (ST0, or reversed ST1 for framed messages)
+        int n_fft_test_i = HSTEP(fft_test_i+SIGNAL_FRAMES);
         
-        if (fft_sum_diffs[CW_ST0[0]][fft_test_i] > MIN_PEAK && fft_sum_diffs[CW_ST0[1]][n_fft_test_i] > MIN_PEAK)
+        // rise over the noise floor of each tone, the decode path runs for credible candidates only
+        DETECTOR_POWER th0 = detector_power_pack(st0_threshold(PROFILE::CW_ST0[0]));
+        DETECTOR_POWER th1 = detector_power_pack(st0_threshold(PROFILE::CW_ST0[1]));
+        bool st0 = frame_sum_diff(PROFILE::CW_ST0[0], fft_test_i) > th0 && frame_sum_diff(PROFILE::CW_ST0[1], n_fft_test_i) > th1;
+        bool st1 = frame_sum_diff(PROFILE::CW_ST0[1], fft_test_i) > th1 && frame_sum_diff(PROFILE::CW_ST0[0], n_fft_test_i) > th0;
+        
+#ifdef PREAMBLE_ENABLED
+        // the correlator has to have found the start pair ending in the oldest test frames, give or take a frame
+        int channel = (int)(detector - detectors);
+        unsigned int block = detector->clock - SIGNAL_TEST_FRAME_LEN;
+        bool gated = preambles != NULL && preambles[channel].lags > 0;
+#ifdef ECHO_CANCEL_ENABLED
+        // our broadcast drowned the pair in the band, the bins have it cancelled
+        gated = gated && preambles[channel].echo_block + SIGNAL_FRAMES <= block;
+#endif
+        if ((st0 || st1) && gated)
         {
-            static int st_test[2][2];
-            static int t1, t2;
-            
-            st_test[0][0] = fft_max_powers[0][fft_test_i];
-            st_test[1][0] = fft_max_powers[1][fft_test_i];
-            st_test[0][1] = fft_max_powers[0][n_fft_test_i];
-            st_test[1][1] = fft_max_powers[1][n_fft_test_i];
-            
-            cw_lookup_test(st_test, CW_ST_TEST_LOOKUP, &t1, &t2, NULL, NULL);
+            st0 &= preamble_offset(channel, block, ST0) >= 0;
+            st1 &= preamble_offset(channel, block, ST1) >= 0;
+#ifdef METERING_ENABLED
+            if (!st0 && !st1) counters.preamble_rejected++;
+#endif
+        }
+        
+#endif
+        if (st0 || st1)
+        {
+            int st = start_test(fft_test_i);
+#ifdef METERING_ENABLED
+            counters.st0_triggers++;
+#endif
             
-            if (t1 == ST0 || t2 == ST0)
+            if ((st0 && st == ST0) || (st1 && st == ST1))
             {
                 LOG({
                     printf("SIGNAL DETECTED\n");
                 });
                 
+#ifdef DECODE_QUEUE_ENABLED
+                // ranked against the candidates of the other channels, the decode path runs once all of them were detected
+                decode_push(fft_test_i, decode_priority(fft_test_i, st));
+#else
                 // decode incoming signal
-                status = DECODE;
+                detector->status = DECODE;
+#endif
             }
+#ifdef METERING_ENABLED
+            else counters.st0_rejected++;
+#endif
         }
     }
 
     // decoding state
-    if (status == DECODE)
+    if (detector->status == DECODE) decode_attempt(fft_test_i, t);
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::noise_update(const Float32 mags[FREQ_COUNT], int bins)
+{
+    // minimum statistics, windows shift every NOISE_WINDOW_LEN frames, the oldest minimum is dropped
+    bool shift = detector->noise_i == 0;
+    detector->noise_i = (detector->noise_i + 1) % NOISE_WINDOW_LEN;
+    
+    for (int f=0; f<FREQ_COUNT; f++)
     {
-        // static allocation
-        static Float32 scoring[4][FULL_SIGNAL_LEN]; // 1st maxi, 2nd maxi, 1st energy, 2nd energy
-        static int payload[PAYLOAD_LEN];
-        static int p_payload[PAYLOAD_LEN];
+        Float32 *min = detector->noise_min[f];
+        Float32 *power = &detector->noise_power[f];
         
-        // reset previous payload data
-        memset(p_payload, 0, sizeof p_payload);
+        // bins not evaluated in this frame keep their smoothed power
+        if (bins & (1 << f)) *power = NOISE_SMOOTHING * *power + (1.0 - NOISE_SMOOTHING) * mags[f];
         
-        for (int i=0; i<SIGNAL_TEST_PADDING; i++)
+        if (shift)
         {
-            // index
-            int fft_i = CSTEP(fft_test_i+i, SIGNAL_TEST_FRAME_LEN);
-            
-            // calculate scoring
-            if (!generate_scoring(fft_i, fft_powers, fft_max_powers, fft_phases, scoring)) break;
-            
-            // calculate payload
-            if (scoring_test(scoring, payload))
-            {
-                // double check payload
-                if (!result && payload_diff(p_payload, payload) <= MAX_PAYLOAD_DIFF)
-                {
-                    // test payload
-                    result = payload_test(payload);
-                    if (result > 0) break; // if success, return with result
-                }
-                memcpy(p_payload, payload, sizeof payload);
-            }
+            for (int k=NOISE_WINDOWS-1; k>0; k--) min[k] = min[k-1];
+            min[0] = *power;
         }
+        else if (*power < min[0]) min[0] = *power;
         
-        // reset detector
-        status = DETECT;
-            
-        // on successful detection skip to next possible signal
-        if (result > 0) f_skip = SIGNAL_TEST_FRAME_LEN;
-    }    
+        // zero until all windows have been filled
+        Float32 floor = min[0];
+        for (int k=1; k<NOISE_WINDOWS; k++) if (min[k] < floor) floor = min[k];
+        detector->noise_floor[f] = NOISE_BIAS * floor;
+    }
 }
 
-unsigned int AudioEx::payload_test(int payload[PAYLOAD_LEN])
+template <class PROFILE>
+Float32 AudioExT<PROFILE>::st0_threshold(int f)
 {
-    int i = 0, pos = 0;
+    Float32 th = ST0_NOISE_RATIO * detector->noise_floor[f];
+    return th > MIN_PEAK ? th : MIN_PEAK;
+}
+
+template <class PROFILE>
+int AudioExT<PROFILE>::start_test(int fft_i)
+{
+    int st_test[2][2];
+    int t1, t2;
+    int n_fft_i = HSTEP(fft_i+SIGNAL_FRAMES);
     
-    // RS code
-    int fec[RS_PARITY];
-    while (i < RS_PARITY) fec[i++] = payload[pos++];
+    st_test[0][0] = MAXIMA_1ST(fft_i);
+    st_test[1][0] = MAXIMA_2ND(fft_i);
+    st_test[0][1] = MAXIMA_1ST(n_fft_i);
+    st_test[1][1] = MAXIMA_2ND(n_fft_i);
     
-    // CRC
-    int crc[CRC_LEN];
-    i = 0;
-    while (i < CRC_LEN) crc[i++] = payload[pos++];
+    cw_lookup_test(st_test, CW_ST_TEST_LOOKUP.v, &t1, &t2, NULL, NULL);
     
-    // DATA
-    int data[DATA_LEN];
-    i = 0;
-    while (i < DATA_LEN) data[i++] = payload[pos++];
+    return t1 > -1 ? t1 : t2;
+}
+
+#ifdef SIC_ENABLED
+static Float32 median(Float32 v[], int n)
+{
+    std::nth_element(v, v + n/2, v + n);
+    return v[n/2];
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::cancel(unsigned int value, int fft_i)
+{
+    // the history keeps mags only, so the code is fitted and subtracted in the power domain
+    int tones[FULL_SIGNAL_LEN];
+    code_tones(value, tones);
     
-    // RS known erasures
-    int n_erasures = 0;
-    int erasures[RS_PARITY];
-    memset(erasures, 0, RS_PARITY * sizeof(int));
+    // background, bins not used by the tone pair of each slot
+    Float32 v[FULL_SIGNAL_LEN*FREQ_COUNT];
+    int n = 0;
+    for (int s=0; s<FULL_SIGNAL_LEN; s++)
+    {
+        int pair = s & ~1;
+        for (int f=0; f<FREQ_COUNT; f++) if (f != tones[pair] && f != tones[pair+1]) v[n++] = frame_mag(f, fft_i + s*SIGNAL_FRAMES);
+    }
+    Float32 floor = median(v, n);
     
-    // fec test code = DATA+CRC+RS (zero padding on 10th position)
-    unsigned char test[RS_N];
-    memset(test, 0x0, RS_N);
+    // tone profile across the slot and the frames it leaks into, median over the slots so colliding tones don't bias it
+    Float32 profile[2*SIGNAL_FRAMES+1];
+    for (int j=-SIGNAL_FRAMES; j<=SIGNAL_FRAMES; j++)
+    {
+        for (int s=0; s<FULL_SIGNAL_LEN; s++) v[s] = frame_mag(tones[s], fft_i + s*SIGNAL_FRAMES + j);
+        Float32 m = median(v, FULL_SIGNAL_LEN) - floor;
+        profile[j+SIGNAL_FRAMES] = m > 0.0 ? m : 0.0;
+    }
     
-#define ADD_ERASURE(x) { erasures[n_erasures++] = x; if (n_erasures == RS_PARITY) return 0; }
+    // subtract, profiles of repeated tones overlap and add up
+    for (int s=0; s<FULL_SIGNAL_LEN; s++)
+    {
+        for (int j=-SIGNAL_FRAMES; j<=SIGNAL_FRAMES; j++)
+        {
+            int t = HSTEP(fft_i + s*SIGNAL_FRAMES + j);
+            Float32 m = frame_mag(tones[s], t) - profile[j+SIGNAL_FRAMES];
+            detector->mags[tones[s]][t] = detector_mag_pack(m > 0.0 ? m : 0.0);
+        }
+    }
     
-    for (i=0; i<DATA_LEN; i++)
+    // maxima and slot pair symbols of the residual over the test window
+    int newest = HSTEP(detector->frame_i-1);
+    for (int t=HSTEP(detector->frame_i+SIGNAL_FRAMES); ; t=HSTEP(t+1))
     {
-        if (data[i] == -1) ADD_ERASURE(i)
-        else test[i] = (unsigned char)data[i];
+        detector->maxima[t] = frame_maxima(t);
+        if (t == newest) break;
+    }
+    for (int t=HSTEP(detector->frame_i+2*SIGNAL_FRAMES); ; t=HSTEP(t+1))
+    {
+        frame_symbol(t);
+        if (t == newest) break;
+    }
+    
+    LOG({
+        printf("CANCELLED: 0x%08X\n", value);
+    });
+}
+#endif
+
+template <class PROFILE>
+unsigned int AudioExT<PROFILE>::decode(int fft_test_i, int* offset)
+{
+    int payload[PAYLOAD_LEN];
+    int p_payload[PAYLOAD_LEN];
+    unsigned int value = 0;
+    
+    // reset previous payload data
+    memset(p_payload, 0, sizeof p_payload);
+    
+    for (int i=0; i<SIGNAL_TEST_PADDING; i++)
+    {
+        // index
+        int fft_i = HSTEP(fft_test_i+i);
+        
+        // check phase changes
+        if (!phase_test(fft_i)) break;
+        
+        // calculate payload
+        if (candidate(fft_i, payload))
+        {
+            // double check payload
+            if (payload_diff(p_payload, payload, PAYLOAD_LEN) <= MAX_PAYLOAD_DIFF)
+            {
+                // test payload
+                value = candidate_test(payload);
+                if (value > 0) // if success, return with value
+                {
+                    *offset = i;
+                    break;
+                }
+            }
+            memcpy(p_payload, payload, sizeof payload);
+        }
+    }
+    
+    return value;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::decode_attempt(int fft_test_i, int t)
+{
+    // candidate whose start pair is the oldest test frame, t is the newest frame
+    int offset = 0;
+    unsigned int value = decode(fft_test_i, &offset);
+    
+    // reset detector
+    detector->status = DETECT;
+    
+#ifdef METERING_ENABLED
+    counters.decode_attempts++;
+    if (value == 0) counters.decode_failures++;
+#endif
+    
+    if (value > 0)
+    {
+        // codes and message headers share the payload, tell them apart by the start pair at the decoded offset
+        if (start_test(HSTEP(fft_test_i+offset)) != ST1)
+        {
+#ifdef SIC_ENABLED
+            // leftovers of a cancelled code may decode again
+            if (detector->sic_hold == 0 || value != detector->sic_value)
+            {
+                if (recent_report(value)) detector->pending = value;
+                
+                // remove the decoded code and keep scanning the residual for a colliding one
+                cancel(value, HSTEP(fft_test_i+offset));
+                detector->sic_value = value;
+                detector->sic_hold = SIGNAL_TEST_FRAME_LEN;
+            }
+#else
+            if (recent_report(value)) detector->pending = value;
+            
+            // on successful detection skip to next possible signal
+            detector->f_skip = SIGNAL_TEST_FRAME_LEN;
+#endif
+        }
+        else
+        {
+            int center = decode_center(fft_test_i, offset, value);
+#ifdef PREAMBLE_ENABLED
+            // the correlator timed the start pair
+            int aligned = preamble_offset((int)(detector - detectors), detector->clock - SIGNAL_TEST_FRAME_LEN, ST1);
+            if (aligned >= 0) center = aligned;
+#endif
+            if (message_start(value, center - SIGNAL_TEST_PADDING + 1))
+            {
+                LOG({
+                    printf("MESSAGE DETECTED\n");
+                });
+                
+                // header decoded, receive data blocks as they arrive, the first one is aligned right after the header
+                detector->status = RECEIVE;
+                message_receive(t);
+            }
+        }
+    }
+}
+
+#ifdef DECODE_QUEUE_ENABLED
+template <class PROFILE>
+Float32 AudioExT<PROFILE>::decode_priority(int fft_test_i, int type)
+{
+    // rise of the weaker start tone over its threshold
+    int f0 = PROFILE::CW_ST0[type];
+    int f1 = PROFILE::CW_ST0[1-type];
+    Float32 r0 = detector_power_unpack(frame_sum_diff(f0, fft_test_i)) / st0_threshold(f0);
+    Float32 r1 = detector_power_unpack(frame_sum_diff(f1, HSTEP(fft_test_i+SIGNAL_FRAMES))) / st0_threshold(f1);
+    
+    // slot pairs without a symbol at the first offset, each one costs RS a parity nibble or more
+    int erasures = 0;
+    for (int s=0; s<SYMBOL_COUNT; s++) if (detector->symbols[HSTEP(fft_test_i + (2+2*s)*SIGNAL_FRAMES)] == -1) erasures++;
+    
+    return (r0 < r1 ? r0 : r1) / (1 + erasures);
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::decode_push(int fft_test_i, Float32 priority)
+{
+    DECODE_QUEUE *queue = decodes;
+    int channel = (int)(detector - detectors);
+    
+    // one job per channel, consecutive triggers of a code rank highest where the start pair fills the test frames
+    DECODE_JOB *job = NULL;
+    for (int k=0; k<queue->len; k++) if (queue->jobs[k].stream == this && queue->jobs[k].channel == channel) job = &queue->jobs[k];
+    
+    if (job != NULL)
+    {
+        if (job->priority >= priority) return;
+    }
+    else
+    {
+        // backed up, low ranked candidates don't wait
+        if (queue->len >= DECODE_BUDGET && priority < DECODE_SHED_PRIORITY)
+        {
+#ifdef METERING_ENABLED
+            counters.decodes_shed++;
+#endif
+            return;
+        }
+        
+        if (queue->len < DECODE_QUEUE_LEN) job = &queue->jobs[queue->len++];
+        else
+        {
+            // full, the lowest ranked job makes room unless this one ranks lower still
+            job = &queue->jobs[0];
+            for (int k=1; k<queue->len; k++) if (queue->jobs[k].priority < job->priority) job = &queue->jobs[k];
+#ifdef METERING_ENABLED
+            if (job->priority >= priority)
+            {
+                counters.decodes_shed++;
+                return;
+            }
+            job->stream->counters.decodes_shed++;
+#else
+            if (job->priority >= priority) return;
+#endif
+        }
+    }
+    
+    job->stream = this;
+    job->channel = channel;
+    job->fft_test_i = fft_test_i;
+    job->clock = detector->clock;
+    job->priority = priority;
+    job->saved = false;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::decode_drain()
+{
+    DECODE_QUEUE *queue = decodes;
+    
+    // highest ranked first, jobs queued in this block decode from the live detector as if they had never waited
+    for (int n=0; n<DECODE_BUDGET && queue->len > 0; n++)
+    {
+        int best = 0;
+        for (int k=1; k<queue->len; k++) if (queue->jobs[k].priority > queue->jobs[best].priority) best = k;
+        
+        DECODE_JOB *job = &queue->jobs[best];
+        AudioExT *stream = job->stream;
+        stream->detector = &stream->detectors[job->channel];
+        stream->receiver = &stream->receivers[job->channel];
+        if (job->saved) stream->decode_saved(job);
+        else stream->decode_attempt(job->fft_test_i, HSTEP(stream->detector->frame_i-1));
+        
+        if (best != --queue->len) *job = queue->jobs[queue->len];
+    }
+    
+    // the rest gather what decode reads of the history before it moves on with the next block
+    for (int k=0; k<queue->len; k++)
+    {
+        DECODE_JOB *job = &queue->jobs[k];
+        const DETECTOR_STATE *live = &job->stream->detectors[job->channel];
+        if (!job->saved)
+        {
+            job->stream->detector = &job->stream->detectors[job->channel];
+            job->stream->decode_gather(job);
+            job->saved = true;
+#ifdef METERING_ENABLED
+            job->stream->counters.decodes_deferred++;
+#endif
+        }
+        else if (live->clock - job->clock >= DECODE_MAX_WAIT)
+        {
+#ifdef METERING_ENABLED
+            job->stream->counters.decodes_shed++;
+#endif
+            if (k != --queue->len) *job = queue->jobs[queue->len];
+            k--;
+        }
+    }
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::decode_gather(DECODE_JOB *job)
+{
+    // payloads and start pairs of the offsets decode and decode_center test, phase tests and slot pair symbols need the history
+    int payload[PAYLOAD_LEN];
+    job->offsets = 0;
+    job->usable = 0;
+    
+    for (int i=0; i<SIGNAL_TEST_PADDING; i++)
+    {
+        int fft_i = HSTEP(job->fft_test_i+i);
+        if (!phase_test(fft_i)) break;
+        
+        if (candidate(fft_i, payload)) job->usable |= 1 << i;
+        for (int j=0; j<PAYLOAD_LEN; j++) job->payloads[i][j] = (signed char)payload[j];
+        job->starts[i] = (signed char)start_test(fft_i);
+        job->offsets++;
+    }
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::decode_saved(DECODE_JOB *job)
+{
+    // the gathered payloads decode as the history did in the block the job was queued, memo and recent codes are the live ones
+    DETECTOR_STATE *live = detector;
+    int wait = (int)(live->clock - job->clock);
+    int payload[PAYLOAD_LEN];
+    int p_payload[PAYLOAD_LEN];
+    unsigned int value = 0;
+    int offset = 0;
+    int center = 0;
+    
+    memset(p_payload, 0, sizeof p_payload);
+    
+    for (int i=0; i<job->offsets; i++)
+    {
+        if (!((job->usable >> i) & 1)) continue;
+        for (int j=0; j<PAYLOAD_LEN; j++) payload[j] = job->payloads[i][j];
+        
+        // double check payload
+        if (payload_diff(p_payload, payload, PAYLOAD_LEN) <= MAX_PAYLOAD_DIFF)
+        {
+            value = candidate_test(payload);
+            if (value > 0)
+            {
+                offset = i;
+                break;
+            }
+        }
+        memcpy(p_payload, payload, sizeof payload);
+    }
+    
+    int st = value > 0 ? job->starts[offset] : ST0;
+    if (value > 0 && st == ST1)
+    {
+        // middle of the offsets decoding the same header, as decode_center
+        int last = offset;
+        for (int i=offset+1; i<job->offsets; i++)
+        {
+            if (!((job->usable >> i) & 1)) break;
+            for (int j=0; j<PAYLOAD_LEN; j++) payload[j] = job->payloads[i][j];
+            if (candidate_test(payload) != value) break;
+            last = i;
+        }
+        center = (offset + last) / 2;
+#ifdef PREAMBLE_ENABLED
+        int aligned = preamble_offset(job->channel, job->clock - SIGNAL_TEST_FRAME_LEN, ST1);
+        if (aligned >= 0) center = aligned;
+#endif
+    }
+    
+#ifdef METERING_ENABLED
+    counters.decode_attempts++;
+    if (value == 0) counters.decode_failures++;
+#endif
+    if (value == 0 || live->status != DETECT) return;
+    
+    if (st != ST1)
+    {
+#ifdef SIC_ENABLED
+        if (live->sic_hold > 0 && value == live->sic_value) return;
+        live->sic_value = value;
+        live->sic_hold = SIGNAL_TEST_FRAME_LEN - wait;
+#endif
+        if (recent_report(value)) live->pending = value;
+        
+        // the code's frames moved on in the history, it can't be cancelled from it, skip past it instead
+        live->f_skip = SIGNAL_TEST_FRAME_LEN - wait;
+    }
+    else if (message_start(value, center - SIGNAL_TEST_PADDING + 1 - wait))
+    {
+        LOG({
+            printf("MESSAGE DETECTED\n");
+        });
+        
+        // the slot pairs that arrived meanwhile are still in the history
+        live->status = RECEIVE;
+        message_receive(HSTEP(live->frame_i-1));
+    }
+}
+#endif
+
+template <class PROFILE>
+int AudioExT<PROFILE>::decode_center(int fft_test_i, int offset, unsigned int value)
+{
+    // the first decodable offset may sit at the edge of the slots, data blocks have no double check
+    // so align them to the middle of the offsets decoding the same header
+    int payload[PAYLOAD_LEN];
+    int last = offset;
+    
+    for (int i=offset+1; i<SIGNAL_TEST_PADDING; i++)
+    {
+        int fft_i = HSTEP(fft_test_i+i);
+        if (!phase_test(fft_i) || !candidate(fft_i, payload) || candidate_test(payload) != value) break;
+        last = i;
+    }
+    
+    return (offset + last) / 2;
+}
+
+template <class PROFILE>
+bool AudioExT<PROFILE>::message_start(unsigned int header, int next)
+{
+    // header: length (16 bits), crc of the message bytes (8 bits), reserved (8 bits)
+    int length = header >> 16;
+    if (length < 1 || length > MESSAGE_MAX_LEN)
+    {
+        LOG({
+            printf("[ERROR] bad message length: %i\n", length);
+        });
+        return false;
+    }
+    
+    int blocks = (2*length + RS_K - 1) / RS_K;
+    
+    receiver->length = length;
+    receiver->crc = (header >> 8) & 0xff;
+    receiver->blocks = blocks;
+    receiver->symbols = (blocks*RS_N*4 + BITS_PER_SYMBOL - 1) / BITS_PER_SYMBOL;
+    receiver->symbol = 0;
+    receiver->next = next;
+#ifdef CLOCK_TRACK_ENABLED
+    receiver->timing = 0.0;
+#endif
+    
+    LOG({
+        printf("MESSAGE: %i bytes, %i blocks, %i symbols\n", length, blocks, receiver->symbols);
+    });
+    
+    return true;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::message_receive(int t)
+{
+    // slot pairs ending at or before the newest frame
+    while (receiver->next + SIGNAL_FRAMES <= 0 && detector->status == RECEIVE)
+    {
+        receiver->data[receiver->symbol++] = detector->symbols[HSTEP(t+receiver->next)];
+#ifdef CLOCK_TRACK_ENABLED
+        // the grid follows the sender clock across the message
+        receiver->next += timing_track(t+receiver->next, &receiver->timing);
+#endif
+        receiver->next += 2*SIGNAL_FRAMES;
+        
+        if (receiver->symbol == receiver->symbols)
+        {
+            message_decode();
+            
+            // skip the message frames still in the test window, the oldest test frame ends up on the last slot
+            detector->status = DETECT;
+            detector->f_skip = SIGNAL_TEST_FRAME_LEN + receiver->next - SIGNAL_FRAMES;
+#ifdef IDLE_GATE_ENABLED
+            // keep the bank running for a signal right after the message
+            detector->gate_hold = SIGNAL_TEST_FRAME_LEN;
+#endif
+        }
+    }
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::message_decode()
+{
+    int symbols[MESSAGE_MAX_SYMBOLS];
+    int nibbles[MESSAGE_MAX_BLOCKS*RS_N];
+    int n_nibbles = receiver->blocks*RS_N;
+    
+    for (int i=0; i<receiver->symbols; i++) symbols[i] = receiver->data[i];
+    nibbles_from_symbols(symbols, receiver->symbols, nibbles, n_nibbles);
+    
+    unsigned char bytes[MESSAGE_MAX_LEN];
+    memset(bytes, 0, sizeof bytes);
+    
+    for (int b=0; b<receiver->blocks; b++)
+    {
+        // deinterleave block, data nibbles first, parity last
+        unsigned char test[RS_N];
+        int erasures[RS_PARITY];
+        int n_erasures = 0;
+        
+        for (int j=0; j<RS_N; j++)
+        {
+            int nibble = nibbles[j*receiver->blocks + b];
+            if (nibble == -1)
+            {
+                if (n_erasures == RS_PARITY)
+                {
+                    LOG({
+                        printf("MESSAGE BLOCK %i: TOO MANY ERASURES\n", b);
+                    });
+                    return;
+                }
+                erasures[n_erasures++] = j;
+                test[j] = 0;
+            }
+            else test[j] = (unsigned char)nibble;
+        }
+        
+        int ret = decode_rs_char(rs_codec, test, erasures, n_erasures);
+        if (ret < 0)
+        {
+            LOG({
+                printf("MESSAGE BLOCK %i: RS(15,11) ERROR: %i\n", b, ret);
+            });
+            return;
+        }
+        
+        // data nibbles, MSB first
+        for (int j=0; j<RS_K; j++)
+        {
+            int n = b*RS_K + j;
+            if (n < 2*receiver->length) bytes[n/2] |= n % 2 ? test[j] : test[j] << 4;
+        }
+    }
+    
+    if (crc8((const char *)bytes, receiver->length) != receiver->crc)
+    {
+        LOG({
+            printf("MESSAGE CRC FAILED\n");
+        });
+        return;
+    }
+    
+    LOG({
+        printf("MESSAGE OK: %i bytes\n", receiver->length);
+    });
+    
+    memcpy(receiver->message, bytes, receiver->length);
+    receiver->message_len = receiver->length;
+}
+
+template <class PROFILE>
+unsigned int AudioExT<PROFILE>::payload_test(int payload[PAYLOAD_LEN])
+{
+    int i = 0, pos = 0;
+    
+    // RS code
+    int fec[RS_PARITY];
+    while (i < RS_PARITY) fec[i++] = payload[pos++];
+    
+    // CRC
+    int crc[CRC_LEN];
+    i = 0;
+    while (i < CRC_LEN) crc[i++] = payload[pos++];
+    
+    // DATA
+    int data[DATA_LEN];
+    i = 0;
+    while (i < DATA_LEN) data[i++] = payload[pos++];
+    
+    // RS known erasures
+    int n_erasures = 0;
+    int erasures[RS_PARITY];
+    memset(erasures, 0, RS_PARITY * sizeof(int));
+    
+    // fec test code = DATA+CRC+RS (zero padding on 10th position)
+    unsigned char test[RS_N];
+    memset(test, 0x0, RS_N);
+    
+#define ADD_ERASURE(x) { erasures[n_erasures++] = x; if (n_erasures == RS_PARITY) return 0; }
+    
+    for (i=0; i<DATA_LEN; i++)
+    {
+        if (data[i] == -1) ADD_ERASURE(i)
+        else test[i] = (unsigned char)data[i];
     }
     for (i=0; i<CRC_LEN; i++)
     {
@@ -300,11 +1205,10 @@ unsigned int AudioEx::payload_test(int payload[PAYLOAD_LEN])
         unsigned char crc_lsb = test[DATA_LEN+1];
         unsigned char crc = (crc_msb << 4) + crc_lsb;
         
-        unsigned char temp[DATA_LEN];
-        for (int i=0; i<DATA_LEN; i++) temp[i] = test[i] < 0x0a ? 0x30 + test[i]: 0x37 + test[i];
-        
-        unsigned int temp_value = strtoul((const char*)temp, NULL, 0x10);
-        unsigned char temp_crc = crc8_int(temp_value);
+        // value nibbles, most significant first
+        unsigned int temp_value = 0;
+        for (int i=0; i<DATA_LEN; i++) temp_value = (temp_value << 4) | test[i];
+        unsigned char temp_crc = crc8_nibbles(test, DATA_LEN);
         
         // crc check
         if (temp_value && temp_crc == crc)
@@ -334,279 +1238,1576 @@ unsigned int AudioEx::payload_test(int payload[PAYLOAD_LEN])
         ret = 0;
     }
     
-    return ret;
+    return ret;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::cw_lookup_test(const int test[2][2], const int lookup[FREQ_COUNT][FREQ_COUNT], int* t1, int* t2, int* t3, int* t4)
+{
+    // 1st - 1st
+    if (t1 != NULL)
+    {
+        int s1 = test[0][0];
+        int s2 = test[0][1];
+        *t1 = (s1 >= 0 && s1 < FREQ_COUNT && s2 >= 0 && s2 < FREQ_COUNT) ? lookup[s1][s2] : -1;
+    }
+    
+    // 1st - 2nd
+    if (t2 != NULL)
+    {
+        int s1 = test[0][0];
+        int s2 = test[1][1];
+        *t2 = (s1 >= 0 && s1 < FREQ_COUNT && s2 >= 0 && s2 < FREQ_COUNT) ? lookup[s1][s2] : -1;
+    }
+    
+    // 2nd - 1st
+    if (t3 != NULL)
+    {
+        int s1 = test[1][0];
+        int s2 = test[0][1];
+        *t3 = (s1 >= 0 && s1 < FREQ_COUNT && s2 >= 0 && s2 < FREQ_COUNT) ? lookup[s1][s2] : -1;
+    }
+    
+    // 2nd - 2nd
+    if (t4 != NULL)
+    {
+        int s1 = test[1][0];
+        int s2 = test[1][1];
+        *t4 = (s1 >= 0 && s1 < FREQ_COUNT && s2 >= 0 && s2 < FREQ_COUNT) ? lookup[s1][s2] : -1;
+    }
+}
+
+template <class PROFILE>
+int AudioExT<PROFILE>::symbol_test(const int maxis[2][2], const DETECTOR_POWER energies[2][2])
+{
+    int t1, t2, t3, t4;
+    
+    // vote symbol freqs
+    cw_lookup_test(maxis, CW_DATA_TEST_LOOKUP.v, &t1, &t2, &t3, &t4);
+    
+    // accumulated energies accross frames
+    DETECTOR_POWER e2 = energies[0][0]+energies[1][1];
+    DETECTOR_POWER e3 = energies[1][0]+energies[0][1];
+    
+    if (t1 > -1) return t1;
+    else if (t2 > -1 && t3 == -1) return t2;
+    else if (t3 > -1 && t2 == -1) return t3;
+    else if (t2 > -1 && t3 > -1) return e2 >= e3 ? t2 : t3;
+    return t4;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::frame_symbol(int t)
+{
+    // symbol of the slot pair whose second slot is frame t, decided once as the frame arrives
+    int u = HSTEP(t-SIGNAL_FRAMES);
+    int maxis[2][2];
+    DETECTOR_POWER energies[2][2];
+    
+    maxis[0][0] = MAXIMA_1ST(u);
+    maxis[1][0] = MAXIMA_2ND(u);
+    maxis[0][1] = MAXIMA_1ST(t);
+    maxis[1][1] = MAXIMA_2ND(t);
+    
+    // overlapping tones correction
+    if (maxis[0][0] == maxis[0][1])
+    {
+        maxis[0][1] = maxis[1][1];
+        maxis[1][1] = maxis[0][0];
+    }
+    
+    // accumulated energies accross frames
+    for (int k=0; k<2; k++)
+    {
+        energies[k][0] = frame_power(maxis[k][0], u);
+        energies[k][1] = frame_power(maxis[k][1], t);
+    }
+    
+    detector->symbols[u] = (signed char)symbol_test(maxis, energies);
+}
+
+template <class PROFILE>
+bool AudioExT<PROFILE>::phase_test(int fft_i)
+{
+    int phase_change_count = 0;
+    for (int s=0; s<FULL_SIGNAL_LEN; s++)
+    {
+        int t = HSTEP(fft_i+s*SIGNAL_FRAMES);
+        if (PHASE_CHANGE(MAXIMA_1ST(t), t) && ++phase_change_count > MAX_PHASE_CHANGE) return false;
+    }
+    
+    return true;
+}
+
+#ifdef CLOCK_TRACK_ENABLED
+template <class PROFILE>
+int AudioExT<PROFILE>::timing_vote(int t)
+{
+    // early/late gate on the slot ending at frame t, sums of its tone over the slot with the grid a frame either way
+    int x = MAXIMA_1ST(HSTEP(t));
+    
+    // a neighbour carrying the same tone keeps the shifted sum up
+    if (MAXIMA_1ST(HSTEP(t-SIGNAL_FRAMES)) == x || MAXIMA_1ST(HSTEP(t+SIGNAL_FRAMES)) == x) return 0;
+    
+    Float32 on = 0.0;
+    for (int i=0; i<SIGNAL_FRAMES; i++) on += frame_mag(x, t-i);
+    Float32 early = on - frame_mag(x, t) + frame_mag(x, t-SIGNAL_FRAMES);
+    Float32 late = on - frame_mag(x, t-SIGNAL_FRAMES+1) + frame_mag(x, t+1);
+    
+    if (late > on && late >= early) return 1;
+    if (early > on) return -1;
+    return 0;
+}
+
+template <class PROFILE>
+int AudioExT<PROFILE>::timing_track(int t, Float32 *timing)
+{
+    // frames the grid moves after the slot pair whose first slot ends at frame t, the slot before it votes too
+    *timing = TIMING_LEAK * *timing + timing_vote(t-SIGNAL_FRAMES) + timing_vote(t);
+    if (fabsf(*timing) < TIMING_THRESHOLD) return 0;
+    
+    int shift = *timing > 0.0 ? 1 : -1;
+    *timing = 0.0;
+#ifdef METERING_ENABLED
+    counters.timing_shifts++;
+#endif
+    return shift;
+}
+#endif
+
+template <class PROFILE>
+bool AudioExT<PROFILE>::candidate(int fft_i, int payload[PAYLOAD_LEN])
+{
+    // payload of the slots starting at fft_i, gathered from the slot pair symbols
+    int symbols[SYMBOL_COUNT];
+    int symbol_i = 0;
+    int error_count = 0;
+    int shift = 0;
+#ifdef CLOCK_TRACK_ENABLED
+    Float32 timing = 0.0;
+#endif
+    
+    while (symbol_i < SYMBOL_COUNT && error_count <= RS_PARITY)
+    {
+        // skip start freqs
+        int u = fft_i + (2+2*symbol_i)*SIGNAL_FRAMES + shift;
+        symbols[symbol_i] = detector->symbols[HSTEP(u)];
+        if (symbols[symbol_i++] == -1) error_count++;
+#ifdef CLOCK_TRACK_ENABLED
+        // the grid follows the sender clock, within the padding of the test window
+        int step = symbol_i < SYMBOL_COUNT ? timing_track(u, &timing) : 0;
+        if (abs(shift + step) < SIGNAL_TEST_PADDING) shift += step;
+#endif
+    }
+    
+    // erased symbols erase every nibble they carry bits of
+    while (symbol_i < SYMBOL_COUNT) symbols[symbol_i++] = -1;
+    error_count = nibbles_from_symbols(symbols, SYMBOL_COUNT, payload, PAYLOAD_LEN);
+    
+    LOG({
+        printf("     ");
+        for (int i=0; i<PAYLOAD_LEN; i++) printf("%c   ", payload[i] == -1 ? '?' : payload[i] < 0x0a ? 0x30 + payload[i]: 0x37 + payload[i]);
+        printf("\n     (ERRORS: %i)\n\n", error_count);
+    });
+    
+    return error_count <= RS_PARITY;
+}
+
+template <class PROFILE>
+unsigned int AudioExT<PROFILE>::candidate_test(int payload[PAYLOAD_LEN])
+{
+    // a repeated beacon decodes to the payload of its last reception
+    unsigned int hash = payload_hash(payload);
+    for (int k=0; k<RECENT_CODES_LEN; k++)
+    {
+        RECENT_CODE *recent = &detector->recent[k];
+        if (recent->value == 0 || recent->hash != hash || detector->clock - recent->seen > (unsigned int)repeat_window) continue;
+        
+        int i = 0;
+        while (i < PAYLOAD_LEN && recent->payload[i] == payload[i]) i++;
+        if (i < PAYLOAD_LEN) continue;
+        
+        recent->seen = detector->clock;
+        return recent->value;
+    }
+    
+    // RS/CRC is a function of the payload only, a payload seen before is answered from the memo
+    unsigned int value = 0;
+    int k = 0;
+    for (; k<detector->memo_len; k++)
+    {
+        int i = 0;
+        while (i < PAYLOAD_LEN && detector->memo[k][i] == payload[i]) i++;
+        if (i == PAYLOAD_LEN) break;
+    }
+    
+    if (k < detector->memo_len) value = detector->memo_value[k];
+    else
+    {
+#ifdef METERING_ENABLED
+        counters.payload_tests++;
+#endif
+        value = payload_test(payload);
+        
+        for (int i=0; i<PAYLOAD_LEN; i++) detector->memo[detector->memo_i][i] = (signed char)payload[i];
+        detector->memo_value[detector->memo_i] = value;
+        detector->memo_i = (detector->memo_i + 1) % DECODE_MEMO_LEN;
+        if (detector->memo_len < DECODE_MEMO_LEN) detector->memo_len++;
+    }
+    if (value == 0) return 0;
+    
+    // remember the code, the entry of the same value or the least recently seen one is replaced
+    RECENT_CODE *recent = &detector->recent[0];
+    for (int k=0; k<RECENT_CODES_LEN; k++)
+    {
+        if (detector->recent[k].value == value) { recent = &detector->recent[k]; break; }
+        if (detector->clock - detector->recent[k].seen > detector->clock - recent->seen) recent = &detector->recent[k];
+    }
+    if (recent->value != value) recent->reported = 0;
+    recent->value = value;
+    recent->hash = hash;
+    for (int i=0; i<PAYLOAD_LEN; i++) recent->payload[i] = (signed char)payload[i];
+    recent->seen = detector->clock;
+    
+    return value;
+}
+
+template <class PROFILE>
+unsigned int AudioExT<PROFILE>::payload_hash(const int payload[PAYLOAD_LEN])
+{
+    // FNV-1a over the nibbles, erasures included
+    unsigned int hash = 2166136261u;
+    for (int i=0; i<PAYLOAD_LEN; i++)
+    {
+        hash ^= (unsigned int)(payload[i] & 0xff);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <class PROFILE>
+bool AudioExT<PROFILE>::recent_report(unsigned int value)
+{
+    // codes decoded within the repeat window of their last report are not reported again
+    for (int k=0; k<RECENT_CODES_LEN; k++)
+    {
+        RECENT_CODE *recent = &detector->recent[k];
+        if (recent->value != value) continue;
+        
+        if (recent->reported != 0 && detector->clock - recent->reported < (unsigned int)repeat_window)
+        {
+#ifdef METERING_ENABLED
+            counters.repeats_suppressed++;
+#endif
+            return false;
+        }
+        recent->reported = detector->clock;
+        break;
+    }
+    
+    return true;
+}
+
+#ifdef FREQ_TRACK_ENABLED
+// bins of a channel retuned to its carrier offset, the shared tables until it has one
+#define BIN_TUNED(_k_) (detectors[(_k_) / FREQ_COUNT].freq_tuned != 0.0)
+#define BIN_COSINE(_k_) (BIN_TUNED(_k_) ? detectors[(_k_) / FREQ_COUNT].bin_cosine[(_k_) % FREQ_COUNT] : tables->cosine[_k_])
+#define BIN_SINE(_k_) (BIN_TUNED(_k_) ? detectors[(_k_) / FREQ_COUNT].bin_sine[(_k_) % FREQ_COUNT] : tables->sine[_k_])
+#define BIN_COSINE_Q30(_k_) (BIN_TUNED(_k_) ? detectors[(_k_) / FREQ_COUNT].bin_cosine_q30[(_k_) % FREQ_COUNT] : tables->cosine_q30[_k_])
+#else
+#define BIN_COSINE(_k_) (tables->cosine[_k_])
+#define BIN_SINE(_k_) (tables->sine[_k_])
+#define BIN_COSINE_Q30(_k_) (tables->cosine_q30[_k_])
+#endif
+
+template <class PROFILE>
+void AudioExT<PROFILE>::goertzel(int f, const Float32 samples[], const Float32 window[], Float32* re, Float32* im)
+{
+    Float32 c = BIN_COSINE(f);
+    Float32 q1 = 0.0, q2 = 0.0;
+    if (window != NULL)
+    {
+        // windowing folded into the recurrence
+        for (int i=0; i<SAMPLING_LENGTH; i++)
+        {
+            Float32 q0 = c * q1 - q2 + samples[i] * window[i];
+            q2 = q1;
+            q1 = q0;
+        }
+    } else {
+        for (int i=0; i<SAMPLING_LENGTH; i++)
+        {
+            Float32 q0 = c * q1 - q2 + samples[i];
+            q2 = q1;
+            q1 = q0;
+        }
+    }
+    
+    // complex part
+    *re = q1 - q2 * 0.5 * c;
+    *im = q2 * BIN_SINE(f);
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::goertzel_bank(const int bins[], int count, const Float32 samples[], Float32 re[], Float32 im[])
+{
+    // four independent recurrences per pass over the block, a single one is bound by its q1/q2 dependency chain
+    int b = 0;
+    for (; b+4<=count; b+=4)
+    {
+        const int *k = &bins[b];
+        Float32 c0 = BIN_COSINE(k[0]), c1 = BIN_COSINE(k[1]), c2 = BIN_COSINE(k[2]), c3 = BIN_COSINE(k[3]);
+        Float32 q1[4] = {0.0, 0.0, 0.0, 0.0};
+        Float32 q2[4] = {0.0, 0.0, 0.0, 0.0};
+        for (int i=0; i<SAMPLING_LENGTH; i++)
+        {
+            Float32 x = samples[i];
+            Float32 q0_0 = c0 * q1[0] - q2[0] + x;
+            Float32 q0_1 = c1 * q1[1] - q2[1] + x;
+            Float32 q0_2 = c2 * q1[2] - q2[2] + x;
+            Float32 q0_3 = c3 * q1[3] - q2[3] + x;
+            q2[0] = q1[0]; q1[0] = q0_0;
+            q2[1] = q1[1]; q1[1] = q0_1;
+            q2[2] = q1[2]; q1[2] = q0_2;
+            q2[3] = q1[3]; q1[3] = q0_3;
+        }
+        
+        // complex part
+        for (int j=0; j<4; j++)
+        {
+            re[k[j]] = q1[j] - q2[j] * 0.5 * BIN_COSINE(k[j]);
+            im[k[j]] = q2[j] * BIN_SINE(k[j]);
+        }
+    }
+    
+    // remaining bins one by one
+    for (; b<count; b++) goertzel(bins[b], samples, NULL, &re[bins[b]], &im[bins[b]]);
+}
+
+#ifdef FIXED_POINT_ENABLED
+template <class PROFILE>
+void AudioExT<PROFILE>::goertzel_q15(int f, const int32_t samples[], Float32* re, Float32* im)
+{
+    // Q15 windowed samples, Q30 coefficient, 32-bit state in Q15 through 64-bit products
+    // a full scale tone on a bin peaks around 2^24, 7 bits of headroom left
+    int64_t c = BIN_COSINE_Q30(f);
+    int32_t q1 = 0, q2 = 0;
+    for (int i=0; i<SAMPLING_LENGTH; i++)
+    {
+        int32_t q0 = (int32_t)((c * q1 + (1 << 29)) >> 30) - q2 + samples[i];
+        q2 = q1;
+        q1 = q0;
+    }
+    
+    // complex part, back to the float scale of the halved window
+    const Float32 scale = 2.0 / 32768.0;
+    *re = (Float32)(q1 - (int32_t)((c * q2 + (1 << 30)) >> 31)) * scale;
+    *im = (Float32)q2 * BIN_SINE(f) * scale;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::goertzel_bank_q15(const int bins[], int count, const int32_t samples[], Float32 re[], Float32 im[])
+{
+    // four independent recurrences per pass over the block, as in the float bank
+    const Float32 scale = 2.0 / 32768.0;
+    int b = 0;
+    for (; b+4<=count; b+=4)
+    {
+        const int *k = &bins[b];
+        int64_t c0 = BIN_COSINE_Q30(k[0]), c1 = BIN_COSINE_Q30(k[1]), c2 = BIN_COSINE_Q30(k[2]), c3 = BIN_COSINE_Q30(k[3]);
+        int32_t q1[4] = {0, 0, 0, 0};
+        int32_t q2[4] = {0, 0, 0, 0};
+        for (int i=0; i<SAMPLING_LENGTH; i++)
+        {
+            int32_t x = samples[i];
+            int32_t q0_0 = (int32_t)((c0 * q1[0] + (1 << 29)) >> 30) - q2[0] + x;
+            int32_t q0_1 = (int32_t)((c1 * q1[1] + (1 << 29)) >> 30) - q2[1] + x;
+            int32_t q0_2 = (int32_t)((c2 * q1[2] + (1 << 29)) >> 30) - q2[2] + x;
+            int32_t q0_3 = (int32_t)((c3 * q1[3] + (1 << 29)) >> 30) - q2[3] + x;
+            q2[0] = q1[0]; q1[0] = q0_0;
+            q2[1] = q1[1]; q1[1] = q0_1;
+            q2[2] = q1[2]; q1[2] = q0_2;
+            q2[3] = q1[3]; q1[3] = q0_3;
+        }
+        
+        // complex part
+        for (int j=0; j<4; j++)
+        {
+            re[k[j]] = (Float32)(q1[j] - (int32_t)(((int64_t)BIN_COSINE_Q30(k[j]) * q2[j] + (1 << 30)) >> 31)) * scale;
+            im[k[j]] = (Float32)q2[j] * BIN_SINE(k[j]) * scale;
+        }
+    }
+    
+    // remaining bins one by one
+    for (; b<count; b++) goertzel_q15(bins[b], samples, &re[bins[b]], &im[bins[b]]);
+}
+#endif
+
+#ifdef HETERODYNE_ENABLED
+template <class PROFILE>
+void AudioExT<PROFILE>::heterodyne(int c, const Float32 samples[], Float32 z_re[HETERODYNE_LEN], Float32 z_im[HETERODYNE_LEN])
+{
+    // mix down, then decimate with a 2nd order CIC filter (integrators at the input rate, combs at the output rate)
+    Float32 i1_re = 0.0, i1_im = 0.0, i2_re = 0.0, i2_im = 0.0;
+    Float32 p_i2_re = 0.0, p_i2_im = 0.0, p_c1_re = 0.0, p_c1_im = 0.0;
+    
+    for (int m=0; m<HETERODYNE_LEN; m++)
+    {
+        if (m < HETERODYNE_LEN-1)
+        {
+            const Float32 *x = &samples[m*HETERODYNE_DECIMATION];
+            const Float32 *lo_re = &tables->lo_re[c][m*HETERODYNE_DECIMATION];
+            const Float32 *lo_im = &tables->lo_im[c][m*HETERODYNE_DECIMATION];
+            for (int i=0; i<HETERODYNE_DECIMATION; i++)
+            {
+                i1_re += x[i] * lo_re[i];
+                i1_im += x[i] * lo_im[i];
+                i2_re += i1_re;
+                i2_im += i1_im;
+            }
+        } else {
+            // windowed block is zero beyond its end, flush the filter tail
+            i2_re += HETERODYNE_DECIMATION * i1_re;
+            i2_im += HETERODYNE_DECIMATION * i1_im;
+        }
+        
+        Float32 c1_re = i2_re - p_i2_re;
+        Float32 c1_im = i2_im - p_i2_im;
+        z_re[m] = c1_re - p_c1_re;
+        z_im[m] = c1_im - p_c1_im;
+        p_i2_re = i2_re;
+        p_i2_im = i2_im;
+        p_c1_re = c1_re;
+        p_c1_im = c1_im;
+    }
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::goertzel_decimated(int f, const Float32 z_re[HETERODYNE_LEN], const Float32 z_im[HETERODYNE_LEN], Float32* re, Float32* im)
+{
+    Float32 q1_re = 0.0, q2_re = 0.0, q1_im = 0.0, q2_im = 0.0;
+    for (int i=0; i<HETERODYNE_LEN; i++)
+    {
+        Float32 q0_re = tables->hd_cosine[f] * q1_re - q2_re + z_re[i];
+        Float32 q0_im = tables->hd_cosine[f] * q1_im - q2_im + z_im[i];
+        q2_re = q1_re;
+        q2_im = q1_im;
+        q1_re = q0_re;
+        q1_im = q0_im;
+    }
+    
+    // complex input: y = q1 - exp(-jw) * q2
+    *re = (q1_re - q2_re * 0.5 * tables->hd_cosine[f] - q2_im * tables->hd_sine[f]) * tables->hd_scale[f];
+    *im = (q1_im - q2_im * 0.5 * tables->hd_cosine[f] + q2_re * tables->hd_sine[f]) * tables->hd_scale[f];
+}
+#endif
+
+#ifdef ECHO_CANCEL_ENABLED
+template <class PROFILE>
+void AudioExT<PROFILE>::echo_reference(const Float32 samples[])
+{
+    // samples rendered by the generator, aligned with the captured block gft gets next
+    if (echo == NULL) return; // batch lane
+    echo_push(samples);
+    echo->fresh = true;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::echo_push(const Float32 samples[])
+{
+    echo->tap = (echo->tap + 1) % ECHO_TAPS;
+    Float32 *r_re = echo->r_re[echo->tap];
+    Float32 *r_im = echo->r_im[echo->tap];
+    
+    bool silent = true;
+    if (samples != NULL) for (int i=0; i<SAMPLING_LENGTH && silent; i++) silent = samples[i] == 0.0;
+    
+    if (silent)
+    {
+        for (int f=0; f<FREQ_COUNT; f++) r_re[f] = r_im[f] = 0.0;
+        if (echo->active > 0) echo->active--;
+    } else {
+        // reference bins of the TX channel, through the same front end as the captured ones
+        echo->channel = signal_generator.channel;
+#ifdef HETERODYNE_ENABLED
+        Float32 z_re[HETERODYNE_LEN];
+        Float32 z_im[HETERODYNE_LEN];
+        heterodyne(echo->channel, samples, z_re, z_im);
+        for (int f=0; f<FREQ_COUNT; f++) goertzel_decimated(f, z_re, z_im, &r_re[f], &r_im[f]);
+#else
+        for (int f=0; f<FREQ_COUNT; f++) goertzel(echo->channel*FREQ_COUNT+f, samples, tables->window, &r_re[f], &r_im[f]);
+#endif
+        echo->active = ECHO_TAPS;
+    }
+    
+    if (echo->active == 0) return;
+    
+    // reference vector, newest block first
+    Float32 *x_re = echo->x_re;
+    Float32 *x_im = echo->x_im;
+    for (int d=0; d<ECHO_TAPS; d++)
+    {
+        int k = (echo->tap - d + ECHO_TAPS) % ECHO_TAPS;
+        for (int g=0; g<FREQ_COUNT; g++)
+        {
+            x_re[d*FREQ_COUNT+g] = echo->r_re[k][g];
+            x_im[d*FREQ_COUNT+g] = echo->r_im[k][g];
+        }
+    }
+    
+    if (echo->p_max == 0.0)
+    {
+        // first broadcast, inverse correlation from the reference power
+        Float32 power = 0.0;
+        for (int i=0; i<ECHO_LEN; i++) power += x_re[i]*x_re[i] + x_im[i]*x_im[i];
+        Float32 p0 = ECHO_LEN / (ECHO_REGULARIZATION * power);
+        for (int i=0; i<ECHO_LEN; i++) echo->p_re[i][i] = p0;
+        echo->p_max = ECHO_LEN * p0;
+    }
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::echo_cancel(int m, int f, Float32* re, Float32* im)
+{
+    // residual = captured bin - echo path * reference vector
+    const Float32 *h_re = echo->h_re[m][f], *h_im = echo->h_im[m][f];
+    const Float32 *x_re = echo->x_re, *x_im = echo->x_im;
+    Float32 y_re = 0.0, y_im = 0.0;
+    for (int i=0; i<ECHO_LEN; i++)
+    {
+        y_re += h_re[i]*x_re[i] - h_im[i]*x_im[i];
+        y_im += h_re[i]*x_im[i] + h_im[i]*x_re[i];
+    }
+    
+    *re -= y_re;
+    *im -= y_im;
+    
+    // the paths are updated once the whole block is known
+    echo->e_re[m][f] = *re;
+    echo->e_im[m][f] = *im;
+    echo->bins |= 1 << f;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::echo_adapt()
+{
+    if (echo->bins == 0) return;
+    
+    const Float32 *x_re = echo->x_re, *x_im = echo->x_im;
+    
+    // pi = P x, gain k = pi / (lambda + x^H pi)
+    Float32 pi_re[ECHO_LEN], pi_im[ECHO_LEN];
+    Float32 alpha = ECHO_FORGETTING;
+    for (int i=0; i<ECHO_LEN; i++)
+    {
+        const Float32 *p_re = echo->p_re[i], *p_im = echo->p_im[i];
+        Float32 a_re = 0.0, a_im = 0.0;
+        for (int j=0; j<ECHO_LEN; j++)
+        {
+            a_re += p_re[j]*x_re[j] - p_im[j]*x_im[j];
+            a_im += p_re[j]*x_im[j] + p_im[j]*x_re[j];
+        }
+        pi_re[i] = a_re;
+        pi_im[i] = a_im;
+        alpha += x_re[i]*a_re + x_im[i]*a_im;
+    }
+    
+    Float32 k_re[ECHO_LEN], k_im[ECHO_LEN];
+    for (int i=0; i<ECHO_LEN; i++)
+    {
+        k_re[i] = pi_re[i] / alpha;
+        k_im[i] = pi_im[i] / alpha;
+    }
+    
+    // h += conj(k) * e, the residual was taken with the old path
+    for (int m=0; m<MIC_COUNT; m++) for (int f=0; f<FREQ_COUNT; f++)
+    {
+        if (!(echo->bins & (1 << f))) continue;
+        Float32 e_re = echo->e_re[m][f], e_im = echo->e_im[m][f];
+        Float32 *h_re = echo->h_re[m][f], *h_im = echo->h_im[m][f];
+        for (int i=0; i<ECHO_LEN; i++)
+        {
+            h_re[i] += k_re[i]*e_re + k_im[i]*e_im;
+            h_im[i] += k_re[i]*e_im - k_im[i]*e_re;
+        }
+    }
+    
+    // P = (P - k pi^H) / lambda, no forgetting once the trace hits the bound
+    Float32 trace = 0.0;
+    for (int i=0; i<ECHO_LEN; i++) trace += echo->p_re[i][i];
+    Float32 scale = trace < echo->p_max ? 1.0 / ECHO_FORGETTING : 1.0;
+    // upper triangle mirrored, P stays hermitian in single precision
+    for (int i=0; i<ECHO_LEN; i++)
+    {
+        Float32 *p_re = echo->p_re[i], *p_im = echo->p_im[i];
+        for (int j=i; j<ECHO_LEN; j++)
+        {
+            p_re[j] = (p_re[j] - (k_re[i]*pi_re[j] + k_im[i]*pi_im[j])) * scale;
+            p_im[j] = (p_im[j] - (k_im[i]*pi_re[j] - k_re[i]*pi_im[j])) * scale;
+            echo->p_re[j][i] = p_re[j];
+            echo->p_im[j][i] = -p_im[j];
+        }
+        p_im[i] = 0.0;
+    }
+    
+    echo->bins = 0;
+}
+#endif
+
+#ifdef IDLE_GATE_ENABLED
+template <class PROFILE>
+bool AudioExT<PROFILE>::gate_test(const Float32 mags2[FREQ_COUNT])
+{
+    bool energy = false;
+    
+    // rising energy on either ST0 tone
+    for (int k=0; k<2; k++)
+    {
+        Float32 mag = mags2[PROFILE::CW_ST0[k]];
+        if (mag > MIN_PEAK && mag > GATE_RATIO * detector->gate_floor[k]) energy = true;
+        // message tones are not noise, don't let them lift the floor
+        if (detector->status != RECEIVE) detector->gate_floor[k] += (mag - detector->gate_floor[k]) * GATE_FLOOR_RATE;
+    }
+    
+    // keep the full bank running until a message started here is fully buffered
+    bool open = energy || detector->gate_hold > 0 || detector->status == RECEIVE;
+    if (energy) detector->gate_hold = SIGNAL_TEST_FRAME_LEN;
+    else if (detector->gate_hold > 0) detector->gate_hold--;
+    
+    // continuously open frames
+    if (!open) detector->gate_open = 0;
+    else if (detector->gate_open < SIGNAL_TEST_FRAME_LEN) detector->gate_open++;
+    
+    return open;
+}
+#endif
+
+#ifdef FREQ_TRACK_ENABLED
+template <class PROFILE>
+template <typename T>
+Float32 AudioExT<PROFILE>::freq_probe(Float32 freq, const T samples[])
+{
+    // power of a windowed block at any freq, coefficients computed on the spot
+    double w = 2.0 * M_PI * freq / sample_rate;
+    Float32 c = 2.0 * cos(w);
+    Float32 q1 = 0.0, q2 = 0.0;
+    for (int i=0; i<SAMPLING_LENGTH; i++)
+    {
+        Float32 q0 = c * q1 - q2 + samples[i];
+        q2 = q1;
+        q1 = q0;
+    }
+    Float32 re = q1 - q2 * 0.5 * c;
+    Float32 im = q2 * (Float32)sin(w);
+    return re*re + im*im;
+}
+
+template <class PROFILE>
+template <typename T>
+void AudioExT<PROFILE>::freq_track(int c, const T samples[], const Float32 gft_re[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT], const Float32 gft_im[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT], const bool evaluated[FREQ_COUNT])
+{
+    // samples: windowed, MIC_COUNT blocks of SAMPLING_LENGTH
+    DETECTOR_STATE *d = &detectors[c];
+    const Float32 *w = d->mic_weight;
+    
+    for (int f=0; f<FREQ_COUNT; f++)
+    {
+        if (evaluated[f]) continue;
+        // gated, the next transmission is measured from scratch
+        d->freq_reference = 0;
+#ifdef IDLE_GATE_ENABLED
+        if (d->gate_open == 0)
+        {
+            d->freq_offset = 0.0;
+            d->freq_probes = FREQ_TRACK_PROBES;
+        }
+#endif
+        return;
+    }
+    
+#ifdef ECHO_CANCEL_ENABLED
+    // our broadcast dominates the raw block, and the echo paths are fitted to the bins as tuned
+    if (echo != NULL && echo->active > 0 && echo->channel == c)
+    {
+        d->freq_reference = 0;
+        return;
+    }
+#endif
+    
+    // a lone tone, the start pair slots first, then every slot of the code
+    Float32 p[FREQ_COUNT];
+    int top = 0;
+    for (int f=0; f<FREQ_COUNT; f++)
+    {
+        p[f] = 0.0;
+        for (int m=0; m<MIC_COUNT; m++) p[f] += w[m] * (gft_re[m][c][f]*gft_re[m][c][f] + gft_im[m][c][f]*gft_im[m][c][f]);
+        if (p[f] > p[top]) top = f;
+    }
+    bool dominant = p[top] > MIN_PEAK;
+    for (int f=0; f<FREQ_COUNT && dominant; f++) if (f != top && FREQ_TRACK_RATIO * p[f] > p[top]) dominant = false;
+    int reference = d->freq_reference - 1;
+    d->freq_reference = dominant ? top + 1 : 0;
+    if (!dominant || reference != top) return;
+    
+    Float32 bin = sample_rate / SAMPLING_LENGTH;
+    
+    // phase advance since the previous frame, 2pi per bin width
+    Float32 a_re = 0.0, a_im = 0.0;
+    for (int m=0; m<MIC_COUNT; m++)
+    {
+        Float32 re = gft_re[m][c][top], im = gft_im[m][c][top];
+        a_re += w[m] * (re*d->p_re[m][top] + im*d->p_im[m][top]);
+        a_im += w[m] * (im*d->p_re[m][top] - re*d->p_im[m][top]);
+    }
+    if (a_re == 0.0 && a_im == 0.0) return;
+    // relative to the advance of the tone itself, e.g. pi for tones on half bins
+    double cycles = (PROFILE::signal_freqs[top] + c * CHANNEL_SPACING) * SAMPLING_LENGTH / sample_rate;
+    double nominal = 2.0 * M_PI * (cycles - floor(cycles));
+    Float32 fine = atan2f(a_im * cos(nominal) - a_re * sin(nominal), a_re * cos(nominal) + a_im * sin(nominal)) / (2.0 * M_PI) * bin;
+    
+    // coarse offset, parabola through the log powers half a bin either side of the tuned bin
+    Float32 coarse = d->freq_offset;
+    if (d->freq_probes > 0)
+    {
+        d->freq_probes--;
+        Float32 center = PROFILE::signal_freqs[top] + c * CHANNEL_SPACING + d->freq_tuned;
+        Float32 lo = 0.0, mid = 0.0, hi = 0.0;
+        for (int m=0; m<MIC_COUNT; m++)
+        {
+            lo += w[m] * freq_probe(center - bin / 2.0, &samples[m*SAMPLING_LENGTH]);
+            mid += w[m] * freq_probe(center, &samples[m*SAMPLING_LENGTH]);
+            hi += w[m] * freq_probe(center + bin / 2.0, &samples[m*SAMPLING_LENGTH]);
+        }
+        coarse = d->freq_tuned;
+        if (lo > 0.0 && mid > 0.0 && hi > 0.0)
+        {
+            Float32 l = logf(lo), h = logf(hi), curve = l - 2.0 * logf(mid) + h;
+            if (curve < 0.0) coarse += fmaxf(-1.0, fminf(1.0, 0.5 * (l - h) / curve)) * bin / 2.0;
+        }
+    }
+    
+    // the phase is exact, the probes or the tracked offset pick its multiple of the bin width
+    Float32 offset = fine + bin * roundf((coarse - fine) / bin);
+    d->freq_offset += FREQ_TRACK_GAIN * (offset - d->freq_offset);
+    d->freq_offset = fmaxf(-FREQ_TRACK_MAX, fminf(FREQ_TRACK_MAX, d->freq_offset));
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::freq_tune(int c)
+{
+    DETECTOR_STATE *d = &detectors[c];
+    Float32 delta = d->freq_offset - d->freq_tuned;
+    if (fabsf(delta) <= FREQ_TRACK_STEP && !(d->freq_offset == 0.0 && d->freq_tuned != 0.0)) return;
+    
+    // a bin's output phase moves with half its freq times the block length, the last frame stays comparable to the next
+    Float32 shift = M_PI * delta * (SAMPLING_LENGTH - 1) / sample_rate;
+    Float32 s_re = cosf(shift), s_im = sinf(shift);
+    for (int m=0; m<MIC_COUNT; m++)
+    {
+        for (int f=0; f<FREQ_COUNT; f++)
+        {
+            Float32 re = d->p_re[m][f], im = d->p_im[m][f];
+            d->p_re[m][f] = re * s_re - im * s_im;
+            d->p_im[m][f] = re * s_im + im * s_re;
+        }
+    }
+    
+    // the channel's bins at the offset, back on the shared tables at 0
+    for (int f=0; f<FREQ_COUNT; f++)
+    {
+        double w = 2.0 * M_PI * (PROFILE::signal_freqs[f] + c * CHANNEL_SPACING + d->freq_offset) / sample_rate;
+        d->bin_cosine[f] = 2.0 * cos(w);
+        d->bin_sine[f] = sin(w);
+#ifdef FIXED_POINT_ENABLED
+        d->bin_cosine_q30[f] = const_q30(2.0 * cos(w));
+#endif
+    }
+    d->freq_tuned = d->freq_offset;
+    
+    // phase advance per block of a tone at the offset, taken out of the phase test
+    Float32 advance = 2.0 * M_PI * d->freq_tuned * SAMPLING_LENGTH / sample_rate;
+    d->freq_rot[0] = cosf(advance);
+    d->freq_rot[1] = sinf(advance);
+}
+#endif
+
+#ifdef PREAMBLE_ENABLED
+template <class PROFILE>
+template <typename T>
+void AudioExT<PROFILE>::preamble_push(int c, const T samples[])
+{
+    // unwindowed, mixed down and summed over PREAMBLE_DECIMATION samples, mic by mic
+    PREAMBLE_CORRELATOR *p = &preambles[c];
+#ifdef ECHO_CANCEL_ENABLED
+    if (echo->active > 0 && echo->channel == c) p->echo_block = detectors[c].clock + 1;
+#endif
+    const Float32 *lo_re = tables->pa_lo_re[c];
+    const Float32 *lo_im = tables->pa_lo_im[c];
+    for (int m=0; m<PREAMBLE_SEGMENT; m++)
+    {
+        for (int mic=0; mic<MIC_COUNT; mic++)
+        {
+            const T *x = &samples[mic*SAMPLING_LENGTH];
+            Float32 re = 0.0, im = 0.0;
+            for (int i=m*PREAMBLE_DECIMATION; i<(m+1)*PREAMBLE_DECIMATION; i++)
+            {
+                re += x[i] * lo_re[i];
+                im += x[i] * lo_im[i];
+            }
+            p->in_re[mic][p->in_len] = re * p->lo[0] - im * p->lo[1];
+            p->in_im[mic][p->in_len] = re * p->lo[1] + im * p->lo[0];
+        }
+        if (++p->in_len == PREAMBLE_FFT_LEN) preamble_correlate(c);
+    }
+    
+    // oscillator phase at the next block, renormalized so rounding doesn't grow it
+    Float32 re = p->lo[0] * tables->pa_step[c][0] - p->lo[1] * tables->pa_step[c][1];
+    Float32 im = p->lo[0] * tables->pa_step[c][1] + p->lo[1] * tables->pa_step[c][0];
+    Float32 norm = 1.0 / sqrtf(re*re + im*im);
+    p->lo[0] = re * norm;
+    p->lo[1] = im * norm;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::preamble_fft(Float32 re[PREAMBLE_FFT_LEN], Float32 im[PREAMBLE_FFT_LEN], bool inverse)
+{
+    // radix-2 in place, unscaled
+    for (int i=1, j=0; i<PREAMBLE_FFT_LEN; i++)
+    {
+        int bit = PREAMBLE_FFT_LEN >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+    
+    // twiddle by twiddle, the butterflies sharing one run back to back
+    Float32 sign = inverse ? -1.0 : 1.0;
+    for (int len=2; len<=PREAMBLE_FFT_LEN; len<<=1)
+    {
+        int half = len/2, step = PREAMBLE_FFT_LEN / len;
+        for (int k=0; k<half; k++)
+        {
+            Float32 w_re = tables->pa_twiddle_re[k*step];
+            Float32 w_im = sign * tables->pa_twiddle_im[k*step];
+            for (int a=k; a<PREAMBLE_FFT_LEN; a+=len)
+            {
+                int b = a+half;
+                Float32 t_re = re[b]*w_re - im[b]*w_im;
+                Float32 t_im = re[b]*w_im + im[b]*w_re;
+                re[b] = re[a] - t_re;
+                im[b] = im[a] - t_im;
+                re[a] += t_re;
+                im[a] += t_im;
+            }
+        }
+    }
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::preamble_correlate(int c)
+{
+    // overlap-save, the first PREAMBLE_SEGMENT-1 samples complete the segments of the previous transform
+    PREAMBLE_CORRELATOR *p = &preambles[c];
+    for (int mic=0; mic<MIC_COUNT; mic++)
+    {
+        const Float32 *in_re = p->in_re[mic], *in_im = p->in_im[mic];
+        Float32 x_re[PREAMBLE_FFT_LEN], x_im[PREAMBLE_FFT_LEN];
+        memcpy(x_re, in_re, sizeof x_re);
+        memcpy(x_im, in_im, sizeof x_im);
+        preamble_fft(x_re, x_im, false);
+        
+        for (int k=0; k<2; k++)
+        {
+            Float32 y_re[PREAMBLE_FFT_LEN], y_im[PREAMBLE_FFT_LEN];
+            const Float32 *h_re = tables->pa_template_re[k];
+            const Float32 *h_im = tables->pa_template_im[k];
+            for (int i=0; i<PREAMBLE_FFT_LEN; i++)
+            {
+                y_re[i] = x_re[i]*h_re[i] - x_im[i]*h_im[i];
+                y_im[i] = x_re[i]*h_im[i] + x_im[i]*h_re[i];
+            }
+            preamble_fft(y_re, y_im, true);
+            
+            // lags past the hop wrapped around the transform, the mics add up like the bins' magnitudes
+            for (int t=0; t<PREAMBLE_HOP; t++)
+            {
+                Float32 *power = &p->power[k][CSTEP(p->lags+t, PREAMBLE_HISTORY_LEN)];
+                *power = (mic > 0 ? *power : 0.0) + y_re[t]*y_re[t] + y_im[t]*y_im[t];
+            }
+        }
+        
+        // band energy under the segment at each lag, running sum
+        Float32 e = 0.0;
+        for (int i=0; i<PREAMBLE_SEGMENT-1; i++) e += in_re[i]*in_re[i] + in_im[i]*in_im[i];
+        for (int t=0; t<PREAMBLE_HOP; t++)
+        {
+            int i = t+PREAMBLE_SEGMENT-1;
+            e += in_re[i]*in_re[i] + in_im[i]*in_im[i];
+            Float32 *energy = &p->energy[CSTEP(p->lags+t, PREAMBLE_HISTORY_LEN)];
+            *energy = (mic > 0 ? *energy : 0.0) + e;
+            e -= in_re[t]*in_re[t] + in_im[t]*in_im[t];
+        }
+        
+        memmove(p->in_re[mic], &in_re[PREAMBLE_HOP], (PREAMBLE_SEGMENT-1) * sizeof(Float32));
+        memmove(p->in_im[mic], &in_im[PREAMBLE_HOP], (PREAMBLE_SEGMENT-1) * sizeof(Float32));
+    }
+    p->lags += PREAMBLE_HOP;
+    p->in_len = PREAMBLE_SEGMENT-1;
+    
+    // lags whose whole pair has been correlated, the score gates and the power weighted by the generator envelope places the pair,
+    // a slot on the pair can't match it again
+    while (p->scan + (2*SIGNAL_FRAMES-1)*PREAMBLE_SEGMENT < p->lags)
+    {
+        Float32 score[2], power[2];
+        preamble_slot(c, p->scan + SIGNAL_FRAMES*PREAMBLE_SEGMENT);
+        preamble_pair(c, p->scan, score, power);
+        for (int type=ST0; type<=ST1; type++)
+        {
+            if (score[type] >= PREAMBLE_MIN_SCORE && power[type] > p->peak_power[type])
+            {
+                p->peak[type] = p->scan;
+                p->peak_power[type] = power[type];
+                p->peak_score[type] = score[type];
+            }
+            else if (p->peak_power[type] > 0.0 && p->scan - p->peak[type] >= SIGNAL_FRAMES*PREAMBLE_SEGMENT)
+            {
+                preamble_found(c, type);
+                p->peak_power[type] = 0.0;
+            }
+        }
+        p->scan++;
+    }
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::preamble_slot(int c, unsigned int lag)
+{
+    // once per lag, as the second slot of a pair, the first slot of the pair a slot later reads it back
+    PREAMBLE_CORRELATOR *p = &preambles[c];
+    Float32 power[2] = {0.0, 0.0}, weighted[2] = {0.0, 0.0}, energy = 0.0;
+    int i = CSTEP(lag, PREAMBLE_HISTORY_LEN);
+    for (int s=0; s<SIGNAL_FRAMES; s++)
+    {
+        for (int k=0; k<2; k++)
+        {
+            power[k] += p->power[k][i];
+            weighted[k] += tables->pa_envelope[s] * p->power[k][i];
+        }
+        energy += p->energy[i];
+        i += PREAMBLE_SEGMENT;
+        if (i >= PREAMBLE_HISTORY_LEN) i -= PREAMBLE_HISTORY_LEN;
+    }
+    
+    i = CSTEP(lag, PREAMBLE_HISTORY_LEN);
+    for (int k=0; k<2; k++)
+    {
+        p->slot_power[k][i] = power[k];
+        p->slot_weighted[k][i] = weighted[k];
+    }
+    p->slot_energy[i] = energy;
 }
 
-void AudioEx::cw_lookup_test(const int test[2][2], const int lookup[FREQ_COUNT][FREQ_COUNT], int* t1, int* t2, int* t3, int* t4)
+template <class PROFILE>
+void AudioExT<PROFILE>::preamble_pair(int c, unsigned int lag, Float32 score[2], Float32 power[2])
 {
-    // 1st - 1st
-    if (t1 != NULL)
+    // ST0 the first start tone over the first slot and the second one over the next slot, ST1 the other way round
+    const PREAMBLE_CORRELATOR *p = &preambles[c];
+    int i[2];
+    i[0] = CSTEP(lag, PREAMBLE_HISTORY_LEN);
+    i[1] = CSTEP(lag + SIGNAL_FRAMES*PREAMBLE_SEGMENT, PREAMBLE_HISTORY_LEN);
+    for (int type=ST0; type<=ST1; type++)
     {
-        int s1 = test[0][0];
-        int s2 = test[0][1];
-        *t1 = (s1 >= 0 && s1 < FREQ_COUNT && s2 >= 0 && s2 < FREQ_COUNT) ? lookup[s1][s2] : -1;
+        // at most 1, the segment power is bounded by its energy times the unit template's, a data slot with one start tone scores 0 in the other
+        score[type] = 1.0;
+        power[type] = 0.0;
+        for (int slot=0; slot<2; slot++)
+        {
+            int k = type == ST0 ? slot : 1-slot;
+            Float32 energy = p->slot_energy[i[slot]];
+            score[type] = fminf(score[type], energy > 0.0 ? p->slot_power[k][i[slot]] / (PREAMBLE_SEGMENT * energy) : 0.0);
+            power[type] += p->slot_weighted[k][i[slot]];
+        }
     }
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::preamble_found(int c, int type)
+{
+    PREAMBLE_CORRELATOR *p = &preambles[c];
     
-    // 1st - 2nd
-    if (t2 != NULL)
+    // parabola through the neighbouring lags, a decimated lag is PREAMBLE_DECIMATION samples
+    Float32 delta = 0.0;
+    if (p->peak[type] > 0)
     {
-        int s1 = test[0][0];
-        int s2 = test[1][1];
-        *t2 = (s1 >= 0 && s1 < FREQ_COUNT && s2 >= 0 && s2 < FREQ_COUNT) ? lookup[s1][s2] : -1;
+        Float32 score[2], l[2], h[2];
+        preamble_pair(c, p->peak[type]-1, score, l);
+        preamble_pair(c, p->peak[type]+1, score, h);
+        Float32 curve = l[type] - 2.0 * p->peak_power[type] + h[type];
+        if (curve < 0.0) delta = fmaxf(-0.5, fminf(0.5, 0.5 * (l[type] - h[type]) / curve));
     }
+    double time = (p->peak[type] + delta) * PREAMBLE_DECIMATION;
     
-    // 2nd - 1st
-    if (t3 != NULL)
-    {
-        int s1 = test[1][0];
-        int s2 = test[0][1];
-        *t3 = (s1 >= 0 && s1 < FREQ_COUNT && s2 >= 0 && s2 < FREQ_COUNT) ? lookup[s1][s2] : -1;
-    }
+    // the detector frame the first slot ends in, one short of the block the rounded end falls in
+    PREAMBLE *found = &p->found[p->found_i];
+    p->found_i = (p->found_i + 1) % PREAMBLE_FOUND;
+    found->block = (unsigned int)((time + SIGNAL_GENERATOR_LEN) / SAMPLING_LENGTH + 0.5) - 2;
+    found->type = type;
+    found->score = p->peak_score[type];
     
-    // 2nd - 2nd
-    if (t4 != NULL)
+    preamble_time = time;
+    preamble_score = p->peak_score[type];
+    preamble_channel = c;
+#ifdef METERING_ENABLED
+    counters.preambles++;
+#endif
+    
+    LOG({
+        printf("START PAIR: %s at %.1f, score %.2f\n", type == ST1 ? "ST1" : "ST0", time, p->peak_score[type]);
+    });
+}
+
+template <class PROFILE>
+int AudioExT<PROFILE>::preamble_offset(int c, unsigned int block, int type)
+{
+    // decode offset of the best start pair whose first slot ends within the test padding from block, -1 if none
+    int best = -1;
+    if (preambles == NULL) return best; // batch lane
+    Float32 best_score = 0.0;
+    for (int k=0; k<PREAMBLE_FOUND; k++)
     {
-        int s1 = test[1][0];
-        int s2 = test[1][1];
-        *t4 = (s1 >= 0 && s1 < FREQ_COUNT && s2 >= 0 && s2 < FREQ_COUNT) ? lookup[s1][s2] : -1;
+        const PREAMBLE *found = &preambles[c].found[k];
+        int offset = (int)(found->block - block);
+        if (found->score <= best_score || found->type != type || offset < -1 || offset > SIGNAL_TEST_PADDING) continue;
+        best = std::max(0, std::min(SIGNAL_TEST_PADDING-1, offset));
+        best_score = found->score;
     }
+    return best;
 }
+#endif
 
-#define POPULATE_MAXIS(_x_) maxis[0][0] = (int)scoring[0][_x_]; maxis[0][1] = (int)scoring[0][_x_+1]; maxis[1][0] = (int)scoring[1][_x_]; maxis[1][1] = (int)scoring[1][_x_+1];
-#define POPULATE_ENERGIES(_x_) energies[0][0] = scoring[2][_x_]; energies[0][1] = scoring[2][_x_+1]; energies[1][0] = scoring[3][_x_]; energies[1][1] = scoring[3][_x_+1];
-
-bool AudioEx::scoring_test(const Float32 scoring[4][FULL_SIGNAL_LEN], int payload[PAYLOAD_LEN])
+template <class PROFILE>
+void AudioExT<PROFILE>::gft(SAMPLE samples[])
 {
-    static int maxis[2][2];
-    static Float32 energies[2][2];
+    // samples: MIC_COUNT blocks of SAMPLING_LENGTH, one after the other
     
-    int payload_i = 0;
-    int scoring_i = 2; // skip start freqs
-    int error_count = 0;
-    int t1, t2, t3, t4;
-    Float32 e1, e2, e3;
+    // complex data, mic by mic and channel by channel
+    Float32 gft_re[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT];
+    Float32 gft_im[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT];
+    
+#ifdef IDLE_GATE_ENABLED
+    // magnitudes^2 of the ST0 tones for the gate, mics combined
+    Float32 gft_mags2[CHANNEL_COUNT][FREQ_COUNT];
+    
+#endif
+    // evaluated freqs
+    bool evaluated[CHANNEL_COUNT][FREQ_COUNT];
+    
+    // bins of the open channels, indexed as c*FREQ_COUNT+f like the coefficients
+    int bank[CHANNEL_COUNT*FREQ_COUNT];
+    int bank_len = 0;
     
-    // check & fill payload data
-    while (payload_i < PAYLOAD_LEN && error_count <= RS_PARITY)
+#ifdef METERING_ENABLED
+    // input level for the snapshot, before the bank windows the block in place
+    meter_pending = meter_due();
+    if (meter_pending)
     {
-        // reset payload data
-        payload[payload_i] = -1;
-        
-        // populate payload data
-        POPULATE_MAXIS(scoring_i)
-        
-        // vote payload freqs
-        cw_lookup_test(maxis, CW_DATA_TEST_LOOKUP, &t1, &t2, &t3, &t4);
-        
-        // populate accumulated energies accross frames
-        POPULATE_ENERGIES(scoring_i);
-        e1 = energies[0][0]+energies[0][1];
-        e2 = energies[0][0]+energies[1][1];
-        e3 = energies[1][0]+energies[0][1];
+        Float32 sum = 0.0;
+        for (int i=0; i<MIC_COUNT*SAMPLING_LENGTH; i++) sum += (Float32)samples[i] * samples[i];
+#ifdef FIXED_POINT_ENABLED
+        sum *= 1.0f / (32768.0f * 32768.0f);
+#endif
+        meter_rms = sqrtf(sum / (MIC_COUNT*SAMPLING_LENGTH));
+    }
+    
+#endif
+#ifdef PREAMBLE_ENABLED
+    for (int c=0; c<CHANNEL_COUNT; c++) preamble_push(c, samples);
+    
+#endif
+#ifdef HETERODYNE_ENABLED
+    // decimated complex band per mic and channel
+    Float32 z_re[MIC_COUNT][CHANNEL_COUNT][HETERODYNE_LEN];
+    Float32 z_im[MIC_COUNT][CHANNEL_COUNT][HETERODYNE_LEN];
+    for (int m=0; m<MIC_COUNT; m++) for (int c=0; c<CHANNEL_COUNT; c++) heterodyne(c, &samples[m*SAMPLING_LENGTH], z_re[m][c], z_im[m][c]);
+#define GFT_BIN(_m_, _c_, _f_, _window_) goertzel_decimated(_f_, z_re[_m_][_c_], z_im[_m_][_c_], &gft_re[_m_][_c_][_f_], &gft_im[_m_][_c_][_f_])
+#define GFT_BANK() for (int m=0; m<MIC_COUNT; m++) for (int b=0; b<bank_len; b++) GFT_BIN(m, bank[b] / FREQ_COUNT, bank[b] % FREQ_COUNT, NULL);
+#elif defined(FIXED_POINT_ENABLED)
+    // Q15 windowed block per mic, shared by the bins of all channels
+    int32_t x_q15[MIC_COUNT][SAMPLING_LENGTH];
+    for (int m=0; m<MIC_COUNT; m++) for (int i=0; i<SAMPLING_LENGTH; i++) x_q15[m][i] = ((int32_t)samples[m*SAMPLING_LENGTH+i] * tables->window_q15[i] + (1 << 14)) >> 15;
+#define GFT_BIN(_m_, _c_, _f_, _window_) goertzel_q15((_c_)*FREQ_COUNT+(_f_), x_q15[_m_], &gft_re[_m_][_c_][_f_], &gft_im[_m_][_c_][_f_])
+#define GFT_BANK() if (bank_len > 0) for (int m=0; m<MIC_COUNT; m++) goertzel_bank_q15(bank, bank_len, x_q15[m], &gft_re[m][0][0], &gft_im[m][0][0]);
+#else
+#define GFT_BIN(_m_, _c_, _f_, _window_) goertzel((_c_)*FREQ_COUNT+(_f_), &samples[(_m_)*SAMPLING_LENGTH], _window_, &gft_re[_m_][_c_][_f_], &gft_im[_m_][_c_][_f_])
+    // Kaiser-Bessel windowing filter, one windowed block per mic shared by the bins of all channels
+#define GFT_BANK() if (bank_len > 0) for (int m=0; m<MIC_COUNT; m++) { Float32 *x = &samples[m*SAMPLING_LENGTH]; for (int i=0; i<SAMPLING_LENGTH; i++) x[i] *= tables->window[i]; goertzel_bank(bank, bank_len, x, &gft_re[m][0][0], &gft_im[m][0][0]); }
+#endif
+    
+#ifdef ECHO_CANCEL_ENABLED
+    // no reference for this block, our broadcast is silent
+    if (!echo->fresh) echo_push(NULL);
+    echo->fresh = false;
+#define GFT_ECHO(_c_, _f_) if (echo->active > 0 && (_c_) == echo->channel) for (int m=0; m<MIC_COUNT; m++) echo_cancel(m, _f_, &gft_re[m][_c_][_f_], &gft_im[m][_c_][_f_]);
+#else
+#define GFT_ECHO(_c_, _f_)
+#endif
+    
+#ifdef IDLE_GATE_ENABLED
+    // combined power, weighted sum over the mics
+#define GFT_POWER(_c_, _f_) { gft_mags2[_c_][_f_] = 0.0; for (int m=0; m<MIC_COUNT; m++) gft_mags2[_c_][_f_] += detectors[_c_].mic_weight[m] * (gft_re[m][_c_][_f_]*gft_re[m][_c_][_f_] + gft_im[m][_c_][_f_]*gft_im[m][_c_][_f_]); }
+#endif
+    
+    for (int c=0; c<CHANNEL_COUNT; c++)
+    {
+        detector = &detectors[c];
+        for (int f=0; f<FREQ_COUNT; f++) evaluated[c][f] = true;
         
-        // scoring payload
-        if (t1 > -1) payload[payload_i] = t1;
-        else if (t2 > -1 && t3 == -1) payload[payload_i] = t2;
-        else if (t3 > -1 && t2 == -1) payload[payload_i] = t3;
-        else if (t2 > -1 && t3 > -1)
+#ifdef IDLE_GATE_ENABLED
+        // ST0 tones first, the rest of the bank runs only if the gate opens
+        for (int k=0; k<2; k++)
         {
-            if (e2 >= e3) payload[payload_i] = t2;
-            else payload[payload_i] = t3;
+            int f = PROFILE::CW_ST0[k];
+            for (int m=0; m<MIC_COUNT; m++) GFT_BIN(m, c, f, tables->window);
+            GFT_ECHO(c, f);
+            GFT_POWER(c, f);
         }
-        else payload[payload_i] = t4;
-        
-        if (payload[payload_i] == -1) error_count++;
         
-        // next scoring index
-        scoring_i+=2;
+        bool open = gate_test(gft_mags2[c]);
+#ifdef ECHO_CANCEL_ENABLED
+        // the paths share one inverse correlation, all bins of our channel run while we are on air
+        open |= echo->active > 0 && c == echo->channel;
+#endif
+        if (!open)
+        {
+            for (int f=0; f<FREQ_COUNT; f++) evaluated[c][f] = (f == PROFILE::CW_ST0[0] || f == PROFILE::CW_ST0[1]);
+            continue;
+        }
         
-        // next payload index
-        payload_i++;
+        for (int f=0; f<FREQ_COUNT; f++)
+        {
+            if (f == PROFILE::CW_ST0[0] || f == PROFILE::CW_ST0[1]) continue;
+            bank[bank_len++] = c*FREQ_COUNT+f;
+        }
+#else
+        for (int f=0; f<FREQ_COUNT; f++) bank[bank_len++] = c*FREQ_COUNT+f;
+#endif
     }
     
-    LOG({
-        printf("     ");
-        for (int i=0; i<PAYLOAD_LEN; i++) printf("%c   ", payload[i] == -1 ? '?' : payload[i] < 0x0a ? 0x30 + payload[i]: 0x37 + payload[i]);
-        printf("\n     (ERRORS: %i)\n\n", error_count);
-    });
+    GFT_BANK();
+    for (int b=0; b<bank_len; b++) GFT_ECHO(bank[b] / FREQ_COUNT, bank[b] % FREQ_COUNT);
+#ifdef ECHO_CANCEL_ENABLED
+    echo_adapt();
+#endif
     
-    return error_count <= RS_PARITY;
+#ifdef FREQ_TRACK_ENABLED
+    // open channels were windowed in place by the bank
+#ifdef FIXED_POINT_ENABLED
+    for (int c=0; c<CHANNEL_COUNT; c++) freq_track(c, &x_q15[0][0], gft_re, gft_im, evaluated[c]);
+#else
+    for (int c=0; c<CHANNEL_COUNT; c++) freq_track(c, samples, gft_re, gft_im, evaluated[c]);
+#endif
+#endif
+    
+    gft_detect(gft_re, gft_im, evaluated);
+    
+#ifdef FREQ_TRACK_ENABLED
+    // after the phases of this frame were saved
+    for (int c=0; c<CHANNEL_COUNT; c++) freq_tune(c);
+#endif
 }
 
-bool AudioEx::generate_scoring(int fft_i, const Float32 fft_powers[FREQ_COUNT][SIGNAL_TEST_FRAME_LEN], const int fft_max_powers[2][SIGNAL_TEST_FRAME_LEN], const int fft_phases[FREQ_COUNT][SIGNAL_TEST_FRAME_LEN], Float32 scoring[2][FULL_SIGNAL_LEN])
+template <class PROFILE>
+void AudioExT<PROFILE>::gft_bins(const Float32 re[CHANNEL_COUNT][FREQ_COUNT], const Float32 im[CHANNEL_COUNT][FREQ_COUNT], const Float32 samples[])
 {
-    int scoring_i = 0, phase_change_count = 0;
-#ifdef DEBUG
-    int _i = fft_i;
+    // all bins of a mono block, computed by the batched front end, samples: the windowed block for the offset probes
+    Float32 gft_re[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT];
+    Float32 gft_im[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT];
+    bool evaluated[CHANNEL_COUNT][FREQ_COUNT];
+    memcpy(gft_re[0], re, sizeof gft_re[0]);
+    memcpy(gft_im[0], im, sizeof gft_im[0]);
+    
+#ifdef METERING_ENABLED
+    meter_pending = meter_due();
+    meter_rms = 0.0;
+#endif
+    
+    for (int c=0; c<CHANNEL_COUNT; c++)
+    {
+        detector = &detectors[c];
+        for (int f=0; f<FREQ_COUNT; f++) evaluated[c][f] = true;
+        
+#ifdef IDLE_GATE_ENABLED
+        // the bank ran anyway, the gate still decides what the detector sees
+        Float32 mags2[FREQ_COUNT];
+        for (int f=0; f<FREQ_COUNT; f++) mags2[f] = gft_re[0][c][f]*gft_re[0][c][f] + gft_im[0][c][f]*gft_im[0][c][f];
+        if (!gate_test(mags2)) for (int f=0; f<FREQ_COUNT; f++) evaluated[c][f] = (f == PROFILE::CW_ST0[0] || f == PROFILE::CW_ST0[1]);
+#endif
+    }
+    
+#ifdef FREQ_TRACK_ENABLED
+    for (int c=0; c<CHANNEL_COUNT; c++) freq_track(c, samples, gft_re, gft_im, evaluated[c]);
+#else
+    (void)samples; // only the offset probes read the block
+#endif
+    
+    gft_detect(gft_re, gft_im, evaluated);
+    
+#ifdef FREQ_TRACK_ENABLED
+    for (int c=0; c<CHANNEL_COUNT; c++) freq_tune(c);
 #endif
-    while (scoring_i < FULL_SIGNAL_LEN)
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::gft_detect(const Float32 gft_re[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT], const Float32 gft_im[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT], const bool evaluated[CHANNEL_COUNT][FREQ_COUNT])
+{
+    // magnitudes^2, mics combined
+    Float32 gft_mags2[CHANNEL_COUNT][FREQ_COUNT];
+    
+    // reset previous result
+    result = 0;
+    message_len = 0;
+    
+    for (int c=0; c<CHANNEL_COUNT; c++)
     {
-        // populate scoring data
+        detector = &detectors[c];
+        receiver = &receivers[c];
         
-        // check phase change
-        if (fft_phases[(int)fft_max_powers[0][fft_i]][fft_i] > 0) phase_change_count++;
-        if (phase_change_count > MAX_PHASE_CHANGE) return false;
+        // phase change flags, one bit per freq
+        PHASE_FLAGS gft_phases = 0;
         
-        // maximas
-        scoring[0][scoring_i] = fft_max_powers[0][fft_i];
-        scoring[1][scoring_i] = fft_max_powers[1][fft_i];
+        // per mic powers for the combining weights
+        Float32 mic_mags2[MIC_COUNT][FREQ_COUNT];
+        const Float32 *w = detector->mic_weight;
         
-        // energies
-        scoring[2][scoring_i] = fft_powers[(int)scoring[0][scoring_i]][fft_i];
-        scoring[3][scoring_i] = fft_powers[(int)scoring[1][scoring_i]][fft_i];
+        for (int f=0; f<FREQ_COUNT; f++)
+        {
+            if (!evaluated[c][f])
+            {
+                // idle freq, no phase reference for the next frame
+                gft_mags2[c][f] = 0.0;
+                for (int m=0; m<MIC_COUNT; m++)
+                {
+                    mic_mags2[m][f] = 0.0;
+                    detector->p_re[m][f] = 0.0;
+                    detector->p_im[m][f] = 0.0;
+                }
+                gft_phases |= 1 << f;
+                continue;
+            }
+            
+            // magnitude squared and phase difference to the previous frame, weighted sums over the mics
+            Float32 mag2 = 0.0, d_re = 0.0, d_im = 0.0;
+            for (int m=0; m<MIC_COUNT; m++)
+            {
+                // complex data for phase calculation
+                Float32 *p_re = detector->p_re[m];
+                Float32 *p_im = detector->p_im[m];
+                
+                Float32 re = gft_re[m][c][f];
+                Float32 im = gft_im[m][c][f];
+                
+#ifdef FREQ_TRACK_ENABLED
+                // a tone off the bin advances by the offset from frame to frame
+                Float32 q_re = p_re[f] * detector->freq_rot[0] - p_im[f] * detector->freq_rot[1];
+                Float32 q_im = p_re[f] * detector->freq_rot[1] + p_im[f] * detector->freq_rot[0];
+#else
+                Float32 q_re = p_re[f], q_im = p_im[f];
+#endif
+                
+                mic_mags2[m][f] = re*re + im*im;
+                mag2 += w[m] * mic_mags2[m][f];
+                d_re += w[m] * (re*q_re + im*q_im);
+                d_im += w[m] * (-im*q_re + re*q_im);
+                
+                // save complex values
+                p_re[f] = re;
+                p_im[f] = im;
+            }
+            gft_mags2[c][f] = mag2;
+            
+            
+            // estimate phase difference
+            /*if(d_re*d_re > d_im*d_im) // phase difference is a multiple of pi
+            {
+                if(d_re > 0) gft_phases[f] = 0;   // sign -> odd
+                else gft_phases[f] = 1;            // sign -> even
+            } else
+            {
+                if(d_im > 0) gft_phases[f] = 2;
+                else gft_phases[f] = 3;
+            }
+            */
+            
+            if(!(d_re*d_re > d_im*d_im && d_re < 0)) gft_phases |= 1 << f;
+        }
         
-        // step frame pointer
-        fft_i = CSTEP(fft_i+SIGNAL_FRAMES, SIGNAL_TEST_FRAME_LEN);
+        if (MIC_COUNT > 1) mic_update(mic_mags2, evaluated[c]);
         
-        // next payload data
-        scoring_i++;
+        // process result
+        detect(gft_mags2[c], gft_phases);
     }
     
-    LOG({
-        printf("\n");
-        
-        for (int i=0; i<FULL_SIGNAL_LEN; i++) printf("%c ", (int)scoring[0][i] == -1 ? '?' : (int)scoring[0][i] < 0x0a ? 0x30 + (int)scoring[0][i]: 0x37 + (int)scoring[0][i]);
-        printf("\n");
-        for (int i=0; i<FULL_SIGNAL_LEN; i++) printf("%c ", (int)scoring[1][i] == -1 ? '?' : (int)scoring[1][i] < 0x0a ? 0x30 + (int)scoring[1][i]: 0x37 + (int)scoring[1][i]);
-        printf("\n");
-        
-        printf("PHASE CHANGE:\n");
-        for (int i=0; i<FULL_SIGNAL_LEN; i++) printf("%i ", (int)scoring[0][i] == -1 ? '?' : fft_phases[(int)scoring[0][i]][CSTEP(_i+(i*SIGNAL_FRAMES), SIGNAL_TEST_FRAME_LEN)]);
-        printf("\n");
-    });
+#ifdef DECODE_QUEUE_ENABLED
+    // the lanes of a batch are drained together by the batch
+    if (!lane) decode_drain();
     
-    // overlapping tones correction
-    for (int i=0; i<FULL_SIGNAL_LEN-1; i+=2)
+#endif
+    report();
+    
+#ifdef METERING_ENABLED
+    if (meter_pending) meter_publish(gft_mags2);
+#endif
+}
+
+#ifdef METERING_ENABLED
+template <class PROFILE>
+bool AudioExT<PROFILE>::meter_due()
+{
+    // a relaxed load per block while nobody reads
+    meter_blocks++;
+    return meter_blocks % METER_DECIMATION == 0 && __atomic_load_n(&meter_wanted, __ATOMIC_RELAXED);
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::meter_publish(const Float32 mags2[CHANNEL_COUNT][FREQ_COUNT])
+{
+    // seqlock, odd while the snapshot is inconsistent, readers retry
+    __atomic_store_n(&meter_seq, meter_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    meter.block = meter_blocks;
+    meter.level = rx_level;
+    meter.rms = meter_rms;
+    for (int c=0; c<CHANNEL_COUNT; c++)
     {
-        if (scoring[0][i] == scoring[0][i+1])
+        const DETECTOR_STATE *d = &detectors[c];
+        for (int f=0; f<FREQ_COUNT; f++)
         {
-            // exchange freq data
-            scoring[0][i+1] = scoring[1][i+1];
-            scoring[1][i+1] = scoring[0][i];
-            // exchange energy data
-            Float32 e = scoring[2][i+1];
-            scoring[2][i+1] = scoring[3][i+1];
-            scoring[3][i+1] = e;
+            // the blocks since the last snapshot are still in the history
+            Float32 peak = meter.peaks[c][f] * METER_PEAK_DECAY;
+            for (int i=1; i<=METER_DECIMATION; i++) peak = fmaxf(peak, detector_mag_unpack(d->mags[f][HSTEP(d->frame_i-i)]));
+            meter.powers[c][f] = mags2[c][f];
+            meter.peaks[c][f] = peak;
+            meter.noise_floor[c][f] = d->noise_floor[f];
         }
     }
     
-    LOG({
-        printf("OVERLAP CORRECTED SIGNAL:\n");
-        for (int i=0; i<FULL_SIGNAL_LEN; i++) printf("%c ", (int)scoring[0][i] == -1 ? '?' : (int)scoring[0][i] < 0x0a ? 0x30 + (int)scoring[0][i]: 0x37 + (int)scoring[0][i]);
-        printf("\n");
-        for (int i=0; i<FULL_SIGNAL_LEN; i++) printf("%c ", (int)scoring[1][i] == -1 ? '?' : (int)scoring[1][i] < 0x0a ? 0x30 + (int)scoring[1][i]: 0x37 + (int)scoring[1][i]);
-        printf("\n\n");
-    });
-    
-    return true;
+    __atomic_store_n(&meter_seq, meter_seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&meter_wanted, 0, __ATOMIC_RELAXED);
 }
 
-void AudioEx::gft(Float32 samples[])
+template <class PROFILE>
+bool AudioExT<PROFILE>::meter_read(METER *snapshot) const
 {
-    // Kaiser-Bessel windowing filter
-    for (int i=0; i<SAMPLING_LENGTH; i++) samples[i] *= wnd_coeffs[i];
+    // the next snapshots get published, a reader polling the meter keeps them coming
+    __atomic_store_n(&meter_wanted, 1, __ATOMIC_RELAXED);
     
-    // magnitudes^2
-    static Float32 gft_mags2[FREQ_COUNT];
-    
-    // complex data for phase calculation
-    static Float32 p_re[FREQ_COUNT];
-    static Float32 p_im[FREQ_COUNT];
-    static int gft_phases[FREQ_COUNT];
-    
-    for (int f=0; f<FREQ_COUNT; f++)
+    for (int i=0; i<METER_READ_TRIES; i++)
     {
-        Float32 q1 = 0.0, q2 = 0.0;
-        for (int i=0; i<SAMPLING_LENGTH; i++)
-        {
-            Float32 q0 = gft_coeff_cosine[f] * q1 - q2 + samples[i];
-            q2 = q1;
-            q1 = q0;
-        }
-        
-        // complex part
-        Float32 re = q1 - q2 * 0.5 * gft_coeff_cosine[f];
-        Float32 im = q2 * gft_coeff_sine[f];
-        
-        // magnitude squared
-        //gft_mags2[f] = q1 * q1 + q2 * q2 - q1 * q2 * gft_coeff_cosine[f];
-        gft_mags2[f] = re*re + im*im;
-        
-        Float32 d_re = re*p_re[f] + im*p_im[f];
-        Float32 d_im = -im*p_re[f] + re*p_im[f];
-        
-        // save complex values
-        p_re[f] = re;
-        p_im[f] = im;
-        
-        
-        // estimate phase difference
-        /*if(d_re*d_re > d_im*d_im) // phase difference is a multiple of pi
-        {
-            if(d_re > 0) gft_phases[f] = 0;   // sign -> odd
-            else gft_phases[f] = 1;            // sign -> even
-        } else
+        unsigned int seq = __atomic_load_n(&meter_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        memcpy(snapshot, &meter, sizeof meter);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&meter_seq, __ATOMIC_RELAXED) == seq) return seq > 0;
+    }
+    return false;
+}
+#endif
+
+template <class PROFILE>
+void AudioExT<PROFILE>::mic_update(const Float32 mags2[MIC_COUNT][FREQ_COUNT], const bool evaluated[FREQ_COUNT])
+{
+    // maximum ratio weights for power combining: signal / noise^2, noise normalized when there is no signal
+    for (int m=0; m<MIC_COUNT; m++)
+    {
+        Float32 lo = 0.0, hi = 0.0;
+        bool first = true;
+        for (int f=0; f<FREQ_COUNT; f++)
         {
-            if(d_im > 0) gft_phases[f] = 2;
-            else gft_phases[f] = 3;
+            if (!evaluated[f]) continue;
+            if (first || mags2[m][f] < lo) lo = mags2[m][f];
+            if (first || mags2[m][f] > hi) hi = mags2[m][f];
+            first = false;
         }
-        */
+        if (first) return;
         
-        if(d_re*d_re > d_im*d_im && d_re < 0) gft_phases[f] = 0;
-        else gft_phases[f] = 1;
+        Float32 *floor = &detector->mic_floor[m];
+        if (*floor == 0.0) *floor = lo;
+        else *floor += MIC_SMOOTHING * (lo - *floor);
+        detector->mic_signal[m] += MIC_SMOOTHING * (fmaxf(hi - *floor, 0.0) - detector->mic_signal[m]);
     }
     
-    // reset previous result
-    result = 0;
+    Float32 w[MIC_COUNT];
+    Float32 sum = 0.0;
+    for (int m=0; m<MIC_COUNT; m++)
+    {
+        Float32 floor = detector->mic_floor[m];
+        if (floor <= 0.0) return;
+        w[m] = (1.0 + detector->mic_signal[m] / floor) / floor;
+        sum += w[m];
+    }
+    for (int m=0; m<MIC_COUNT; m++) detector->mic_weight[m] = w[m] / sum;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::report()
+{
+#ifdef METERING_ENABLED
+    // loudest channel
+    rx_level = 0.0;
+    for (int c=0; c<CHANNEL_COUNT; c++) if (detectors[c].p_rx_level > rx_level) rx_level = detectors[c].p_rx_level;
+#endif
     
-    // process result
-    detect(gft_mags2, gft_phases);
+    // one code and one message per block, channels decoded in the same block are reported with the next ones
+    for (int c=0; c<CHANNEL_COUNT && result == 0; c++)
+    {
+        if (detectors[c].pending == 0) continue;
+        result = detectors[c].pending;
+        result_channel = c;
+        detectors[c].pending = 0;
+    }
+    for (int c=0; c<CHANNEL_COUNT && message_len == 0; c++)
+    {
+        if (receivers[c].message_len == 0) continue;
+        memcpy(message, receivers[c].message, receivers[c].message_len);
+        message_len = receivers[c].message_len;
+        message_channel = c;
+        receivers[c].message_len = 0;
+    }
 }
 
-#define H_LEN (DATA_LEN+CRC_LEN+1) // must be less than RS_N
+template <class PROFILE>
+void AudioExT<PROFILE>::signal_generator_data_from_int(unsigned int value, int data[])
+{
+    code_tones(value, data);
+    signal_generator.data_len = FULL_SIGNAL_LEN;
+}
 
-void AudioEx::signal_generator_data_from_int(unsigned int value, AUDIO_DATA& data)
+template <class PROFILE>
+void AudioExT<PROFILE>::code_tones(unsigned int value, int data[])
 {
-    // calculate 8-bit checksum
-    unsigned char crc = crc8_int(value);
+    // value nibbles, most significant first, and their 8-bit checksum
+    unsigned char r[RS_N];
+    memset(r, 0x0, RS_N);
+    for (int i=0; i<DATA_LEN; i++) r[i] = (value >> (4*(DATA_LEN-1-i))) & 0x0f;
+    unsigned char crc = crc8_nibbles(r, DATA_LEN);
     unsigned char crc_msb = (crc & 0xf0) >> 4;
     unsigned char crc_lsb = crc & 0x0f;
-    // values
-    char h[H_LEN];
-    snprintf(h, H_LEN, "%08X%01X%01X", value, crc_msb, crc_lsb);
     // START
     int j = 0;
-    data[j++] = CW_ST0[0];
-    data[j++] = CW_ST0[1];
+    data[j++] = PROFILE::CW_ST0[0];
+    data[j++] = PROFILE::CW_ST0[1];
     // ECC
-    // RS(15, 11)
-    unsigned char r[RS_N];
-    memset(r, 0x0, RS_N);
-    for (int i=0; i<H_LEN-1; i++) r[i] = h[i] < 0x41 ? h[i] - 0x30 : h[i] - 0x37;
+    // RS(15, 11), DATA + CRC
+    r[DATA_LEN] = crc_msb;
+    r[DATA_LEN+1] = crc_lsb;
     encode_rs_char(rs_codec, &r[0], &r[RS_N-RS_PARITY]);
-    for (int i=0; i<RS_PARITY; i++)
+    // payload nibbles, ECC + CRC + DATA
+    int payload[PAYLOAD_LEN];
+    int k = 0;
+    for (int i=0; i<RS_PARITY; i++) payload[k++] = r[RS_N-RS_PARITY+i];
+    payload[k++] = crc_msb;
+    payload[k++] = crc_lsb;
+    for (int i=0; i<DATA_LEN; i++) payload[k++] = r[i];
+    // tone pairs
+    int symbols[SYMBOL_COUNT];
+    symbols_from_nibbles(payload, PAYLOAD_LEN, symbols, SYMBOL_COUNT);
+    for (int i=0; i<SYMBOL_COUNT; i++)
     {
-        data[j++] = CW_DATA[r[RS_N-RS_PARITY+i]][0];
-        data[j++] = CW_DATA[r[RS_N-RS_PARITY+i]][1];
+        data[j++] = PROFILE::CW_DATA[symbols[i]][0];
+        data[j++] = PROFILE::CW_DATA[symbols[i]][1];
     }
-    // CRC
+}
+
+template <class PROFILE>
+int AudioExT<PROFILE>::signal_generator_data_from_bytes(const unsigned char bytes[], int len, int data[])
+{
+    if (len < 1 || len > MESSAGE_MAX_LEN)
+    {
+        LOG({
+            printf("[ERROR] bad message length: %i\n", len);
+        });
+        return 0;
+    }
+    
+    // header code, started with the reversed start pair (ST1)
+    unsigned char crc = crc8((const char *)bytes, len);
+    signal_generator_data_from_int((len << 16) | (crc << 8), data);
+    data[0] = PROFILE::CW_ST0[1];
+    data[1] = PROFILE::CW_ST0[0];
+    
+    // RS(15, 11) blocks of data nibbles, MSB first, zero padded
+    int blocks = (2*len + RS_K - 1) / RS_K;
+    unsigned char r[MESSAGE_MAX_BLOCKS][RS_N];
+    memset(r, 0x0, sizeof r);
+    for (int n=0; n<2*len; n++) r[n/RS_K][n%RS_K] = n % 2 ? bytes[n/2] & 0x0f : bytes[n/2] >> 4;
+    for (int b=0; b<blocks; b++) encode_rs_char(rs_codec, &r[b][0], &r[b][RS_N-RS_PARITY]);
+    
+    // interleave blocks across symbols for burst protection
+    int nibbles[MESSAGE_MAX_BLOCKS*RS_N];
+    for (int j=0; j<RS_N; j++) for (int b=0; b<blocks; b++) nibbles[j*blocks + b] = r[b][j];
+    
+    // tone pairs
+    int n_symbols = (blocks*RS_N*4 + BITS_PER_SYMBOL - 1) / BITS_PER_SYMBOL;
+    int symbols[MESSAGE_MAX_SYMBOLS];
+    symbols_from_nibbles(nibbles, blocks*RS_N, symbols, n_symbols);
+    int j = FULL_SIGNAL_LEN;
+    for (int i=0; i<n_symbols; i++)
     {
-        // MSB
-        data[j++] = CW_DATA[crc_msb][0];
-        data[j++] = CW_DATA[crc_msb][1];
-        // LSB
-        data[j++] = CW_DATA[crc_lsb][0];
-        data[j++] = CW_DATA[crc_lsb][1];
+        data[j++] = PROFILE::CW_DATA[symbols[i]][0];
+        data[j++] = PROFILE::CW_DATA[symbols[i]][1];
     }
-    // DATA
-    for (int i=0; i<DATA_LEN; i++)
+    
+    signal_generator.data_len = j;
+    return j;
+}
+
+template <class PROFILE>
+void AudioExT<PROFILE>::symbols_from_nibbles(const int nibbles[], int n_nibbles, int symbols[], int n_symbols)
+{
+    // nibbles concatenated MSB first, split into BITS_PER_SYMBOL wide symbols, last one zero padded
+    for (int i=0; i<n_symbols; i++)
+    {
+        int symbol = 0;
+        for (int b=i*BITS_PER_SYMBOL; b<(i+1)*BITS_PER_SYMBOL; b++)
+        {
+            int bit = b < n_nibbles*4 ? (nibbles[b/4] >> (3 - b%4)) & 1 : 0;
+            symbol = (symbol << 1) | bit;
+        }
+        symbols[i] = symbol;
+    }
+}
+
+template <class PROFILE>
+int AudioExT<PROFILE>::nibbles_from_symbols(const int symbols[], int n_symbols, int nibbles[], int n_nibbles)
+{
+    // inverse of symbols_from_nibbles, returns the number of erased nibbles
+    int erasures = 0;
+    for (int i=0; i<n_nibbles && i*4/BITS_PER_SYMBOL<n_symbols; i++)
     {
-        data[j++] = CW_DATA[r[i]][0];
-        data[j++] = CW_DATA[r[i]][1];
+        int nibble = 0;
+        for (int b=i*4; b<(i+1)*4; b++)
+        {
+            int symbol = symbols[b/BITS_PER_SYMBOL];
+            if (symbol == -1)
+            {
+                nibble = -1;
+                break;
+            }
+            nibble = (nibble << 1) | ((symbol >> (BITS_PER_SYMBOL - 1 - b%BITS_PER_SYMBOL)) & 1);
+        }
+        nibbles[i] = nibble;
+        if (nibble == -1) erasures++;
     }
+    return erasures;
 }
 
-void AudioEx::signal_generator_reset()
+template <class PROFILE>
+void AudioExT<PROFILE>::signal_generator_reset()
 {
     signal_generator.length = SIGNAL_GENERATOR_LEN;
     signal_generator.carrier = 0.0;
@@ -615,7 +2816,8 @@ void AudioEx::signal_generator_reset()
     signal_generator.data_pos = -1;
 }
 
-bool AudioEx::signal_generator_data(AUDIO_DATA& data)
+template <class PROFILE>
+bool AudioExT<PROFILE>::signal_generator_data(const int data[])
 {
     // check remaining samples
     if (signal_generator.remaining > 0)
@@ -626,7 +2828,7 @@ bool AudioEx::signal_generator_data(AUDIO_DATA& data)
         return false;
     }
     // load freq data
-    if (++signal_generator.data_pos < FULL_SIGNAL_LEN)
+    if (++signal_generator.data_pos < signal_generator.data_len)
     {
         int freq_num = data[signal_generator.data_pos];
         if (freq_num < 0 || freq_num > FREQ_COUNT)
@@ -636,7 +2838,7 @@ bool AudioEx::signal_generator_data(AUDIO_DATA& data)
             });
             return false;
         }
-        signal_generator.carrier = signal_freqs[freq_num];
+        signal_generator.carrier = PROFILE::signal_freqs[freq_num] + signal_generator.channel * CHANNEL_SPACING;
         //signal_generator.phase = (signal_generator.data_pos % 2 ? 1.0 /*sin(M_PI_2)*/ : 0.0);
         signal_generator.remaining = signal_generator.length;
         // DEBUG
@@ -653,7 +2855,127 @@ bool AudioEx::signal_generator_data(AUDIO_DATA& data)
     return false;
 }
 
-AudioEx::~AudioEx()
+template <class PROFILE>
+AudioExT<PROFILE>::~AudioExT()
+{
+    if (!lane) free_rs_char(rs_codec);
+    free(resampler.coeffs);
+    free(resampler.history);
+    free(custom_tables);
+#ifdef PREAMBLE_ENABLED
+    free(preambles);
+#endif
+#ifdef ECHO_CANCEL_ENABLED
+    free(echo);
+#endif
+#ifdef DECODE_QUEUE_ENABLED
+    if (!lane) free(decodes);
+#endif
+}
+
+template <class PROFILE, int LANES>
+AudioExBatchT<PROFILE, LANES>::AudioExBatchT()
+{
+    // lanes hold the detector state only, RS is stateless between calls so one codec serves them all
+    rs_codec = init_rs_char(STREAM::RS_SYMSIZE, STREAM::RS_POLY, 1, 1, STREAM::RS_PARITY);
+    for (int l=0; l<LANES; l++) streams[l] = new STREAM(rs_codec);
+#ifdef DECODE_QUEUE_ENABLED
+    // one queue for all lanes, a loud event triggers many of them in the same block
+    decodes = (typename STREAM::DECODE_QUEUE *)calloc(1, sizeof(typename STREAM::DECODE_QUEUE));
+    for (int l=0; l<LANES; l++) streams[l]->decodes = decodes;
+#endif
+}
+
+template <class PROFILE, int LANES>
+AudioExBatchT<PROFILE, LANES>::~AudioExBatchT()
 {
+    for (int l=0; l<LANES; l++) delete streams[l];
     free_rs_char(rs_codec);
+#ifdef DECODE_QUEUE_ENABLED
+    free(decodes);
+#endif
+}
+
+template <class PROFILE, int LANES>
+void AudioExBatchT<PROFILE, LANES>::gft(const Float32 samples[])
+{
+    // samples: SAMPLING_LENGTH frames of LANES interleaved streams
+    const typename STREAM::GFT_TABLES *tables = &STREAM::PROTOCOL_GFT_TABLES;
+    
+    // Kaiser-Bessel windowing filter, lane by lane
+    for (int i=0; i<SAMPLING_LENGTH; i++)
+    {
+        Float32 w = tables->window[i];
+        for (int l=0; l<LANES; l++) x[i][l] = samples[i*LANES+l] * w;
+    }
+    
+    // one recurrence per bin for all lanes, lanes are independent so the inner loops vectorize
+    for (int k=0; k<BINS; k++)
+    {
+        // each lane's bin at its own carrier offset, as in the lane's BIN_COSINE
+        alignas(32) Float32 c[LANES];
+        alignas(32) Float32 s[LANES];
+        for (int l=0; l<LANES; l++)
+        {
+            c[l] = tables->cosine[k];
+            s[l] = tables->sine[k];
+#ifdef FREQ_TRACK_ENABLED
+            const typename STREAM::DETECTOR_STATE *d = &streams[l]->detectors[k / FREQ_COUNT];
+            if (d->freq_tuned != 0.0)
+            {
+                c[l] = d->bin_cosine[k % FREQ_COUNT];
+                s[l] = d->bin_sine[k % FREQ_COUNT];
+            }
+#endif
+        }
+        alignas(32) Float32 q1[LANES] = {};
+        alignas(32) Float32 q2[LANES] = {};
+        for (int i=0; i<SAMPLING_LENGTH; i++)
+        {
+            for (int l=0; l<LANES; l++)
+            {
+                Float32 q0 = c[l] * q1[l] - q2[l] + x[i][l];
+                q2[l] = q1[l];
+                q1[l] = q0;
+            }
+        }
+        
+        // complex part
+        for (int l=0; l<LANES; l++)
+        {
+            re[l][k] = q1[l] - q2[l] * 0.5 * c[l];
+            im[l][k] = q2[l] * s[l];
+        }
+    }
+    
+    // detection stays per stream
+    for (int l=0; l<LANES; l++)
+    {
+#ifdef FREQ_TRACK_ENABLED
+        // the lane's windowed block for its offset probes
+        Float32 lane[SAMPLING_LENGTH];
+        for (int i=0; i<SAMPLING_LENGTH; i++) lane[i] = x[i][l];
+        streams[l]->gft_bins((const Float32 (*)[FREQ_COUNT])re[l], (const Float32 (*)[FREQ_COUNT])im[l], lane);
+#else
+        streams[l]->gft_bins((const Float32 (*)[FREQ_COUNT])re[l], (const Float32 (*)[FREQ_COUNT])im[l], NULL);
+#endif
+    }
+    
+#ifdef DECODE_QUEUE_ENABLED
+    // candidates of all lanes ranked together, lanes decoding now report with this block
+    streams[0]->decode_drain();
+    for (int l=0; l<LANES; l++) streams[l]->report();
+#endif
 }
+
+// supported profiles
+template class AudioExT<PROFILE_DEFAULT>;
+template class AudioExT<PROFILE_FAST>;
+template class AudioExT<PROFILE_ROBUST>;
+template class AudioExT<PROFILE_WIDE>;
+template class AudioExT<PROFILE_FDM>;
+template class AudioExT<PROFILE_ARRAY<2>>;
+template class AudioExT<PROFILE_ARRAY<4>>;
+template class AudioExT<PROFILE_ARRAY<8>>;
+template class AudioExBatchT<PROFILE_DEFAULT, 8>;
+template class AudioExBatchT<PROFILE_DEFAULT, 16>;
@@ -5,11 +5,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <math.h>
+#include <type_traits>
 #include "rs.h"
 
 #define DEBUG
 #define METERING_ENABLED
+#define IDLE_GATE_ENABLED // run the full Goertzel bank only around ST0 energy
+//#define HETERODYNE_ENABLED // mix the band down and decimate before the Goertzel bank
+//#define DETECTOR_COMPACT_MAGS // 16-bit detector history, halves per-stream footprint
+#define SIC_ENABLED // cancel decoded codes from the history and rescan the residual for colliding ones
+#define ECHO_CANCEL_ENABLED // subtract our own broadcast from the bins, rendered samples are fed back as reference
+//#define FIXED_POINT_ENABLED // int16 capture blocks, Q15 window, fixed-point Goertzel bank and integer detector powers for nodes with weak FPUs
+#define FREQ_TRACK_ENABLED // measure the carrier offset from the start pair on, retune the channel's bins and its phase reference
+#define CLOCK_TRACK_ENABLED // follow the sender's symbol clock, early/late votes on the stored frame mags move the slot grid
+//#define PREAMBLE_ENABLED // FFT matched filter on the start pair, arrival time to a few decimated samples, energy triggers without one skip the decode path
+//#define DECODE_QUEUE_ENABLED // start pair candidates of all channels and batch lanes queue as decode jobs, a budget of them runs per block, the rest wait with their payloads gathered or are shed
+
+#if defined(FIXED_POINT_ENABLED) && defined(HETERODYNE_ENABLED)
+#error "the heterodyne front end runs in float only"
+#endif
+#if defined(FIXED_POINT_ENABLED) && defined(DETECTOR_COMPACT_MAGS)
+#error "the fixed-point detector keeps 32-bit integer mags, 16 bits don't hold their range"
+#endif
+#if defined(FREQ_TRACK_ENABLED) && defined(HETERODYNE_ENABLED)
+#error "the heterodyne front end shares its decimated bins between channels, they can't be retuned one by one"
+#endif
 
 #ifdef DEBUG
 #define LOG(_x_) _x_
@@ -19,31 +41,147 @@
 
 typedef float Float32;
 
-// freqs
-#define FREQ_COUNT 7
-
-// audio samples filtering window size
-#define SAMPLING_LENGTH 525 //  44100/525=84 multiple integer
+#ifdef FIXED_POINT_ENABLED
+// capture samples, Q15 PCM
+typedef int16_t SAMPLE;
+static inline SAMPLE sample_pack(Float32 v) { Float32 q = v * 32768.0f; return (SAMPLE)(q >= 32767.0f ? 32767 : q <= -32768.0f ? -32768 : lrintf(q)); }
+#else
+typedef Float32 SAMPLE;
+static inline SAMPLE sample_pack(Float32 v) { return v; }
+#endif
 
-//static const Float32 signal_freqs[FREQ_COUNT] = {18518.0, 18690.0, 18862.0, 19035.0, 19207.0, 19379.0, 19552.0}; // bins: 215, 217, 219, 221, 223, 225, 227 (1 bin width = 86.13Hz)
-static const Float32 signal_freqs[FREQ_COUNT] = {18102.0, 18270.0, 18438.0, 18606.0, 18774.0, 18942.0, 19110.0}; // bins: 215, 217, 219, 221, 223, 225, 227 (1 bin width = 84.00Hz)
+// protocol tables (SAMPLING_LENGTH, signal_freqs) are tuned for this rate, other capture rates are resampled to it
+#define PROTOCOL_SAMPLE_RATE 44100
 
 typedef int FREQ_PAIR[2];
 
-#define CW_DATA_LEN 16
+// generated codeword tone pairs, ordered by tone distance, skipping the start pair
+template <int N>
+struct CW_PAIRS {
+    FREQ_PAIR v[N];
+    constexpr const FREQ_PAIR& operator[](int i) const { return v[i]; }
+};
+
+template <int FREQS, int LEN>
+constexpr CW_PAIRS<LEN> cw_data_pairs(int st0_0, int st0_1)
+{
+    CW_PAIRS<LEN> pairs = {};
+    int n = 0;
+    for (int d=1; d<FREQS; d++)
+    {
+        for (int i=0; i+d<FREQS && n<LEN; i++)
+        {
+            if (i == st0_0 && i+d == st0_1) continue;
+            pairs.v[n][0] = i;
+            pairs.v[n][1] = i+d;
+            n++;
+        }
+    }
+    return pairs;
+}
+
+// protocol profiles, AudioExT is instantiated for each of them in AudioEx.cpp
+struct PROFILE_DEFAULT {
+    enum {
+        // freqs
+        FREQ_COUNT = 7,
+        // audio samples filtering window size
+        SAMPLING_LENGTH = 525, //  44100/525=84 multiple integer
+        // frames per symbol
+        SIGNAL_FRAMES = 4,
+        // hex nibbles per code
+        DATA_LEN = 8,
+        // error correction coding parameters
+        RS_SYMSIZE = 4,
+        RS_PARITY = 4,
+        RS_POLY = 0x13,
+        // tone pairs, 2^BITS_PER_SYMBOL of them
+        CW_DATA_LEN = 16,
+        BITS_PER_SYMBOL = 4,
+        // frequency division channels, each one is signal_freqs shifted by c*CHANNEL_SPACING Hz
+        CHANNEL_COUNT = 1,
+        CHANNEL_SPACING = 1176, // 7*168Hz, next channel starts one carrier step above the last one
+        // microphones, one block per mic is combined into a single detector
+        MIC_COUNT = 1,
+    };
+    
+    //static constexpr Float32 signal_freqs[FREQ_COUNT] = {18518.0, 18690.0, 18862.0, 19035.0, 19207.0, 19379.0, 19552.0}; // bins: 215, 217, 219, 221, 223, 225, 227 (1 bin width = 86.13Hz)
+    static constexpr Float32 signal_freqs[FREQ_COUNT] = {18102.0, 18270.0, 18438.0, 18606.0, 18774.0, 18942.0, 19110.0}; // bins: 215, 217, 219, 221, 223, 225, 227 (1 bin width = 84.00Hz)
+    
+    static constexpr FREQ_PAIR CW_ST0 = {0, 6};
+    static constexpr FREQ_PAIR CW_DATA[CW_DATA_LEN] = {{0, 1}, {5, 6}, {1, 2}, {4, 5}, {2, 3}, {3, 4}, {0, 2}, {4, 6}, {1, 3}, {3, 5}, {2, 4}, {0, 3}, {3, 6}, {1, 4}, {2, 5}, {0, 4}}; // 0..F
+};
+
+// short symbols, 3/4 of the airtime of the default profile
+struct PROFILE_FAST : PROFILE_DEFAULT {
+    enum {
+        SIGNAL_FRAMES = 3,
+    };
+};
+
+// long symbols, for reverberant rooms and low SNR
+struct PROFILE_ROBUST : PROFILE_DEFAULT {
+    enum {
+        SIGNAL_FRAMES = 8,
+    };
+};
 
-static const FREQ_PAIR CW_ST0 = {0, 6};
-static const FREQ_PAIR CW_DATA[CW_DATA_LEN] = {{0, 1}, {5, 6}, {1, 2}, {4, 5}, {2, 3}, {3, 4}, {0, 2}, {4, 6}, {1, 3}, {3, 5}, {2, 4}, {0, 3}, {3, 6}, {1, 4}, {2, 5}, {0, 4}}; // 0..F
+// two transmitters sharing the band, 18102-19110Hz and 19278-20286Hz, decoded from one windowed block
+struct PROFILE_FDM : PROFILE_DEFAULT {
+    enum {
+        CHANNEL_COUNT = 2,
+    };
+};
+
+// fixed installations, 2-8 microphones per node, bins combined before detection
+template <int MICS>
+struct PROFILE_ARRAY : PROFILE_DEFAULT {
+    enum {
+        MIC_COUNT = MICS,
+    };
+};
+
+// 12 carriers on the same 168Hz grid, 6 bits per tone pair, 22 instead of 30 symbol slots per code
+struct PROFILE_WIDE : PROFILE_DEFAULT {
+    enum {
+        FREQ_COUNT = 12,
+        CW_DATA_LEN = 64,
+        BITS_PER_SYMBOL = 6,
+    };
+    
+    static constexpr Float32 signal_freqs[FREQ_COUNT] = {18102.0, 18270.0, 18438.0, 18606.0, 18774.0, 18942.0, 19110.0, 19278.0, 19446.0, 19614.0, 19782.0, 19950.0};
+    
+    static constexpr FREQ_PAIR CW_ST0 = {0, 11};
+    static constexpr CW_PAIRS<CW_DATA_LEN> CW_DATA = cw_data_pairs<FREQ_COUNT, CW_DATA_LEN>(0, 11);
+};
 
-#define SIGNAL_FRAMES 4
-#define SIGNAL_GENERATOR_LEN (SIGNAL_FRAMES*SAMPLING_LENGTH)
+// heterodyne front end, decimation must divide SAMPLING_LENGTH
+// band center -> DC, 44100/15=2940Hz complex rate covers the +/-504Hz carriers, 35(+1 tail) samples per window
+#define HETERODYNE_DECIMATION 15
 
-// error correction coding parameters
-#define RS_SYMSIZE 4
-#define RS_PARITY 4
-#define RS_POLY 0x13
-#define RS_N ((1 << RS_SYMSIZE) - 1)
-#define RS_K (RS_N - RS_PARITY)
+// start pair correlator, the band between the start tones of each mic mixed down and decimated as above, then
+// correlated by overlap-save FFT against one block long segments of each start tone, segment powers are weighted by
+// the generator envelope and summed over the pair and the mics without their phases, a carrier offset only costs score
+#define PREAMBLE_DECIMATION 15 // start tones at +/-504Hz, +/-924Hz in the wide profile
+#define PREAMBLE_FFT_LEN 256 // 222 new decimated samples per transform, ~6 blocks
+#define PREAMBLE_MIN_SCORE 0.06 // segment power over band energy in the weaker slot, 1 for a clean start pair, about twice what noise scores
+
+// decode queue, candidates ranked by the rise of their start pair over the floor per erased symbol, jobs run in the block
+// they were queued until more are queued than the budget, the ones left gather the payloads of their offsets meanwhile
+#define DECODE_QUEUE_LEN 16 // jobs, ~90 bytes each in the default profile
+#define DECODE_BUDGET 2 // decode runs per block, up to SIGNAL_TEST_PADDING offsets each
+#define DECODE_SHED_PRIORITY 2.0 // candidates below it are shed while a budget's worth is queued
+#define DECODE_MAX_WAIT 16 // blocks, ~190ms, older jobs are shed
+
+// mic combining, per-mic noise floor and signal power averages
+#define MIC_SMOOTHING 0.03125 // ~32 blocks
+
+// echo canceller, complex RLS per captured bin over all reference bins of the last ECHO_TAPS blocks
+// adjacent carriers sit inside the window main lobe, their leakage rotates with the echo delay at their own freq
+// every bin sees the same reference vector, so one inverse correlation is shared by all paths
+#define ECHO_TAPS 8 // ~95ms of output to input latency
+#define ECHO_FORGETTING 0.999 // ~1000 blocks of memory, a remote code overlapping our broadcast is not learned into the path
+#define ECHO_REGULARIZATION 0.01 // of the reference power, initial inverse correlation
 
 typedef struct {
     int length;
@@ -51,66 +189,623 @@ typedef struct {
     double carrier;
     double phase;
     int data_pos;
+    int data_len; // slots, FULL_SIGNAL_LEN for codes
+    int channel;
 } SIGNAL_GENERATOR;
 
 #define ST_LEN 1
 #define CRC_LEN 2
-#define ECC_LEN (RS_PARITY + CRC_LEN)
-#define DATA_LEN 8
-
-#define FULL_SIGNAL_LEN (2*(ST_LEN+ECC_LEN+DATA_LEN))
-#define SIGNAL_TEST_PADDING (SIGNAL_FRAMES)
-#define SIGNAL_TEST_FRAME_LEN (SIGNAL_FRAMES*FULL_SIGNAL_LEN+SIGNAL_TEST_PADDING)
-#define PAYLOAD_LEN (ECC_LEN+DATA_LEN)
-
-typedef int AUDIO_DATA[FULL_SIGNAL_LEN];
 
 #define MIN_PEAK 0.003
 #define MAX_PAYLOAD_DIFF 4
-#define MAX_PHASE_CHANGE (FULL_SIGNAL_LEN/2)
+#define DECODE_MEMO_LEN 8 // recent payloads and their RS/CRC results, consecutive offsets and frames mostly repeat them
+#define RECENT_CODES_LEN 4 // decoded codes kept with their payloads, a repeated beacon is accepted without RS/CRC
+#define RECENT_CODES_WINDOW 5.0 // seconds a repeated code is not reported again
+
+// per-bin noise floor, minimum statistics of the smoothed frame power over NOISE_WINDOWS*NOISE_WINDOW_LEN frames
+#define NOISE_SMOOTHING 0.75
+#define NOISE_WINDOWS 4
+#define NOISE_WINDOW_LEN 48 // 4*48 frames, ~2.3s at 84 frames/s, longer than a code so its own tones don't lift the floor
+#define NOISE_BIAS 2.0 // minimum of the smoothed power to mean noise power
+// start pair rise over the floor, a diff of two noise frames exceeds k*floor with probability e^-k/2
+// higher values cut more noise triggers at the cost of sensitivity near the decode limit
+#define ST0_NOISE_RATIO 1.0
+
+// carrier offset tracking, cheap speakers and sample clock mismatch shift the tones by tens of Hz
+// the phase advance of a lone tone per block measures the offset up to a multiple of the bin width,
+// probes half a bin either side of it pick the multiple, the start pair slots acquire it before the data arrives
+#define FREQ_TRACK_RATIO 4.0 // lone tone power over each other tone
+#define FREQ_TRACK_GAIN 0.25 // per measured frame, overlapping transmissions jitter single measurements
+#define FREQ_TRACK_MAX 80.0 // Hz
+#define FREQ_TRACK_STEP 2.0 // Hz, offset change retuning the bins
+#define FREQ_TRACK_PROBES 4 // frames probed per transmission, later ones take the multiple from the tracked offset
+
+// symbol clock tracking, a sender clock 0.1% off slides the slots of a 128 byte message by ~2 frames
+// each slot whose neighbours carry other tones votes for the grid a frame earlier or later when that sum of its tone is higher
+#define TIMING_LEAK 0.75 // per slot pair
+#define TIMING_THRESHOLD 2.5 // leaky votes moving the grid a frame, two pairs of agreeing votes or four single ones
+
+// idle gate, ST0 tone energy over its tracked floor opens the full bank
+#define GATE_RATIO 8.0
+#define GATE_FLOOR_RATE (1.0/64)
 
 #define ST0 0
+#define ST1 1 // reversed start pair, a message header follows
 
-static const int CW_ST_TEST_LOOKUP[FREQ_COUNT][FREQ_COUNT] = {
-    {  -1,  -1,  -1,  -1,  -1,  -1, ST0},
-    {  -1,  -1,  -1,  -1,  -1,  -1,  -1},
-    {  -1,  -1,  -1,  -1,  -1,  -1,  -1},
-    {  -1,  -1,  -1,  -1,  -1,  -1,  -1},
-    {  -1,  -1,  -1,  -1,  -1,  -1,  -1},
-    {  -1,  -1,  -1,  -1,  -1,  -1,  -1},
-    {  -1,  -1,  -1,  -1,  -1,  -1,  -1}
-};
+// metering snapshot, published through a seqlock while someone reads it
+#define METER_DECIMATION 4 // blocks per snapshot, ~21Hz
+#define METER_PEAK_DECAY 0.7 // peak hold per snapshot, ~0.5s to -15dB
+#define METER_READ_TRIES 16 // a reader gives up on a writer it keeps overlapping
 
-static const int CW_DATA_TEST_LOOKUP[FREQ_COUNT][FREQ_COUNT] = {
-    {  -1, 0x0, 0x6, 0xb, 0xf,  -1,  -1},
-    {  -1,  -1, 0x2, 0x8, 0xd,  -1,  -1},
-    {  -1,  -1,  -1, 0x4, 0xa, 0xe,  -1},
-    {  -1,  -1,  -1,  -1, 0x5, 0x9, 0xc},
-    {  -1,  -1,  -1,  -1,  -1, 0x3, 0x7},
-    {  -1,  -1,  -1,  -1,  -1,  -1, 0x1},
-    {  -1,  -1,  -1,  -1,  -1,  -1,  -1}
+// framed messages, header code + interleaved RS(15, 11) data blocks
+#define MESSAGE_MAX_LEN 128 // bytes
+
+// codeword test lookups generated from the profile's tone pairs
+template <int N>
+struct CW_LOOKUP {
+    int v[N][N];
 };
 
-class AudioEx {
+template <class PROFILE>
+constexpr CW_LOOKUP<PROFILE::FREQ_COUNT> cw_st_test_lookup()
+{
+    CW_LOOKUP<PROFILE::FREQ_COUNT> lookup = {};
+    for (int i=0; i<PROFILE::FREQ_COUNT; i++) for (int j=0; j<PROFILE::FREQ_COUNT; j++) lookup.v[i][j] = -1;
+    lookup.v[PROFILE::CW_ST0[0]][PROFILE::CW_ST0[1]] = ST0;
+    lookup.v[PROFILE::CW_ST0[1]][PROFILE::CW_ST0[0]] = ST1;
+    return lookup;
+}
+
+template <class PROFILE>
+constexpr CW_LOOKUP<PROFILE::FREQ_COUNT> cw_data_test_lookup()
+{
+    CW_LOOKUP<PROFILE::FREQ_COUNT> lookup = {};
+    for (int i=0; i<PROFILE::FREQ_COUNT; i++) for (int j=0; j<PROFILE::FREQ_COUNT; j++) lookup.v[i][j] = -1;
+    for (int i=0; i<PROFILE::CW_DATA_LEN; i++) lookup.v[PROFILE::CW_DATA[i][0]][PROFILE::CW_DATA[i][1]] = i;
+    return lookup;
+}
+
+// compile-time math for the window and freq bin tables, double precision
+constexpr double Ino(double x)
+{
+    // zeroth order modified Bessel function of the first kind, Kaiser window denominator
+    double d = 0.0, ds = 1.0, s = 1.0;
+    do
+    {
+        d += 2.0;
+        ds *= x * x / (d * d);
+        s += ds;
+    }
+    while (ds > s * 1e-6);
+    return s;
+}
+
+constexpr double const_sqrt(double x)
+{
+    if (x <= 0.0) return 0.0;
+    double r = x > 1.0 ? x : 1.0;
+    for (int i=0; i<64; i++)
+    {
+        double n = 0.5 * (r + x / r);
+        if (n >= r) break;
+        r = n;
+    }
+    return r;
+}
+
+constexpr double const_sin(double x)
+{
+    // reduced to [-pi, pi], taylor series to double precision
+    x -= 2.0 * M_PI * (long long)(x / (2.0 * M_PI));
+    if (x > M_PI) x -= 2.0 * M_PI;
+    if (x < -M_PI) x += 2.0 * M_PI;
+    double term = x, s = x;
+    for (int n=1; n<32 && (term > 1e-17 || term < -1e-17); n++)
+    {
+        term *= -x * x / ((2*n) * (2*n + 1));
+        s += term;
+    }
+    return s;
+}
+
+constexpr double const_cos(double x)
+{
+    return const_sin(x + M_PI / 2.0);
+}
+
+constexpr int32_t const_q30(double x)
+{
+    // rounded and saturated, 2cos(w) spans the whole int32 range
+    double c = x * 1073741824.0;
+    return (int32_t)(c >= 2147483647.0 ? 2147483647.0 : c <= -2147483648.0 ? -2147483648.0 : c < 0.0 ? c - 0.5 : c + 0.5);
+}
+
+// polyphase resampler, Kaiser windowed sinc prototype
+#define RESAMPLER_TAPS 32 // taps per phase, scaled up by the decimation ratio
+#define RESAMPLER_MAX_PHASES 1024 // up factor limit, rate pairs with a larger ratio run unresampled
+#define RESAMPLER_KAISER_BETA 6.0
+
+typedef struct {
+    int up; // 0 if not resampling
+    int down;
+    int taps;
+    Float32 *coeffs; // [up][taps], reversed per phase
+    Float32 *history; // [mics][2*taps], mirrored so each phase reads a contiguous window
+    int history_i;
+    int phase;
+} RESAMPLER;
+
+typedef enum {
+    DETECT = 0,
+    DECODE = 1,
+    RECEIVE = 2,
+} DETECTOR_STATUS;
+
+// sums of mags over frames and their differences, what detect() compares
+#ifdef FIXED_POINT_ENABLED
+// magnitudes^2 in steps of 2^-DETECTOR_MAG_Q, MIN_PEAK is ~200 steps, a full scale square wave on a bin reaches 2^16.4,
+// leaving the top 1.6 bits before saturation
+#define DETECTOR_MAG_Q 14
+typedef uint32_t DETECTOR_MAG;
+typedef int64_t DETECTOR_POWER;
+static inline DETECTOR_MAG detector_mag_pack(Float32 v) { Float32 q = v * (Float32)(1 << DETECTOR_MAG_Q); return q >= 4294967295.0f ? UINT32_MAX : q > 0.0f ? (DETECTOR_MAG)(q + 0.5f) : 0; }
+static inline Float32 detector_mag_unpack(DETECTOR_MAG v) { return (Float32)v * (1.0f / (1 << DETECTOR_MAG_Q)); }
+static inline DETECTOR_POWER detector_mag_power(DETECTOR_MAG v) { return v; }
+static inline DETECTOR_POWER detector_power_pack(Float32 v) { return (DETECTOR_POWER)llrintf(v * (Float32)(1 << DETECTOR_MAG_Q)); }
+static inline Float32 detector_power_unpack(DETECTOR_POWER v) { return (Float32)v * (1.0f / (1 << DETECTOR_MAG_Q)); }
+#else
+typedef Float32 DETECTOR_POWER;
+#ifdef DETECTOR_COMPACT_MAGS
+// upper half of the IEEE single (bfloat16), same range as Float32 with 8 bit mantissa
+typedef uint16_t DETECTOR_MAG;
+static inline DETECTOR_MAG detector_mag_pack(Float32 v) { union { Float32 f; uint32_t i; } u; u.f = v; return (DETECTOR_MAG)((u.i + 0x8000) >> 16); }
+static inline Float32 detector_mag_unpack(DETECTOR_MAG v) { union { Float32 f; uint32_t i; } u; u.i = (uint32_t)v << 16; return u.f; }
+#else
+typedef Float32 DETECTOR_MAG;
+static inline DETECTOR_MAG detector_mag_pack(Float32 v) { return v; }
+static inline Float32 detector_mag_unpack(DETECTOR_MAG v) { return v; }
+#endif
+static inline DETECTOR_POWER detector_mag_power(DETECTOR_MAG v) { return detector_mag_unpack(v); }
+static inline DETECTOR_POWER detector_power_pack(Float32 v) { return v; }
+static inline Float32 detector_power_unpack(DETECTOR_POWER v) { return v; }
+#endif
+
+template <class PROFILE>
+class AudioExT {
 public:
-    Float32 rx_level;
+    enum {
+        FREQ_COUNT = PROFILE::FREQ_COUNT,
+        SAMPLING_LENGTH = PROFILE::SAMPLING_LENGTH,
+        SIGNAL_FRAMES = PROFILE::SIGNAL_FRAMES,
+        SIGNAL_GENERATOR_LEN = SIGNAL_FRAMES*SAMPLING_LENGTH,
+        RS_SYMSIZE = PROFILE::RS_SYMSIZE,
+        RS_PARITY = PROFILE::RS_PARITY,
+        RS_POLY = PROFILE::RS_POLY,
+        RS_N = (1 << RS_SYMSIZE) - 1,
+        RS_K = RS_N - RS_PARITY,
+        ECC_LEN = RS_PARITY + CRC_LEN,
+        DATA_LEN = PROFILE::DATA_LEN,
+        PAYLOAD_LEN = ECC_LEN+DATA_LEN, // nibbles
+        BITS_PER_SYMBOL = PROFILE::BITS_PER_SYMBOL,
+        SYMBOL_COUNT = (PAYLOAD_LEN*4+BITS_PER_SYMBOL-1)/BITS_PER_SYMBOL, // tone pairs carrying the payload
+        FULL_SIGNAL_LEN = 2*(ST_LEN+SYMBOL_COUNT),
+        SIGNAL_TEST_PADDING = SIGNAL_FRAMES,
+        SIGNAL_TEST_FRAME_LEN = SIGNAL_FRAMES*FULL_SIGNAL_LEN+SIGNAL_TEST_PADDING,
+        MAX_PHASE_CHANGE = FULL_SIGNAL_LEN/2,
+        // detector history, SIGNAL_FRAMES frames longer than the test window so sums and diffs of the oldest test frame can be derived
+        HISTORY_LEN = SIGNAL_TEST_FRAME_LEN+SIGNAL_FRAMES,
+        HETERODYNE_LEN = SAMPLING_LENGTH/HETERODYNE_DECIMATION+1,
+        CHANNEL_COUNT = PROFILE::CHANNEL_COUNT,
+        CHANNEL_SPACING = PROFILE::CHANNEL_SPACING,
+        ECHO_LEN = ECHO_TAPS*FREQ_COUNT,
+        MIC_COUNT = PROFILE::MIC_COUNT,
+    };
+    
+    static_assert(RS_SYMSIZE == 4 && DATA_LEN == 8, "codes are 32-bit values sent as hex nibbles");
+    static_assert(DATA_LEN + CRC_LEN <= RS_K, "data and crc must fit the RS message");
+    static_assert(FREQ_COUNT <= 16, "maxima are packed as tone index nibbles");
+    static_assert(PROFILE::CW_DATA_LEN == 1 << BITS_PER_SYMBOL, "one tone pair per symbol value");
+    static_assert(PROFILE::CW_DATA_LEN < FREQ_COUNT*(FREQ_COUNT-1)/2, "not enough tone pairs");
+    static_assert(CHANNEL_COUNT >= 1 && (CHANNEL_COUNT == 1 || CHANNEL_SPACING > PROFILE::signal_freqs[FREQ_COUNT-1] - PROFILE::signal_freqs[0]), "channels must not overlap");
+    static_assert(PROFILE::signal_freqs[FREQ_COUNT-1] + (CHANNEL_COUNT-1)*CHANNEL_SPACING < PROTOCOL_SAMPLE_RATE/2, "channel plan exceeds nyquist");
+    static_assert(MIC_COUNT >= 1 && MIC_COUNT <= 8, "1-8 microphones");
+    
+    // phase change flags, one bit per freq
+    typedef typename std::conditional<FREQ_COUNT <= 8, uint8_t, uint16_t>::type PHASE_FLAGS;
+#ifdef HETERODYNE_ENABLED
+    static_assert(SAMPLING_LENGTH % HETERODYNE_DECIMATION == 0, "HETERODYNE_DECIMATION must divide SAMPLING_LENGTH");
+#endif
+#ifdef PREAMBLE_ENABLED
+    enum {
+        PREAMBLE_SEGMENT = SAMPLING_LENGTH/PREAMBLE_DECIMATION, // decimated samples per block
+        PREAMBLE_HOP = PREAMBLE_FFT_LEN-PREAMBLE_SEGMENT+1, // lags per transform
+        PREAMBLE_HISTORY_LEN = (3*SIGNAL_FRAMES+1)*PREAMBLE_SEGMENT+PREAMBLE_FFT_LEN, // a pair and the slot its peak is held for behind a transform of lags
+        PREAMBLE_FOUND = 2*(SIGNAL_TEST_FRAME_LEN/SIGNAL_FRAMES+1), // a slot apart at least per type, kept until their energy trigger reaches the oldest test frame
+    };
+    static_assert(SAMPLING_LENGTH % PREAMBLE_DECIMATION == 0, "PREAMBLE_DECIMATION must divide SAMPLING_LENGTH");
+    static_assert((PREAMBLE_FFT_LEN & (PREAMBLE_FFT_LEN-1)) == 0 && PREAMBLE_FFT_LEN > 2*PREAMBLE_SEGMENT, "PREAMBLE_FFT_LEN must be a power of 2 well above a segment");
+#endif
+    
+    // window and freq bin coefficients, read-only and shared by every instance at the same rate
+    typedef struct {
+        Float32 window[SAMPLING_LENGTH]; // Kaiser-Bessel
+        Float32 cosine[CHANNEL_COUNT*FREQ_COUNT]; // freq bins, channel by channel
+        Float32 sine[CHANNEL_COUNT*FREQ_COUNT];
+#ifdef HETERODYNE_ENABLED
+        Float32 lo_re[CHANNEL_COUNT][SAMPLING_LENGTH]; // windowed local oscillators
+        Float32 lo_im[CHANNEL_COUNT][SAMPLING_LENGTH];
+        Float32 hd_cosine[FREQ_COUNT]; // decimated freq bins
+        Float32 hd_sine[FREQ_COUNT];
+        Float32 hd_scale[FREQ_COUNT];
+#endif
+#ifdef PREAMBLE_ENABLED
+        Float32 pa_lo_re[CHANNEL_COUNT][SAMPLING_LENGTH]; // start pair band to DC, one block of oscillator
+        Float32 pa_lo_im[CHANNEL_COUNT][SAMPLING_LENGTH];
+        Float32 pa_step[CHANNEL_COUNT][2]; // oscillator phase advance per block, cos and sin
+        Float32 pa_twiddle_re[PREAMBLE_FFT_LEN/2];
+        Float32 pa_twiddle_im[PREAMBLE_FFT_LEN/2];
+        Float32 pa_template_re[2][PREAMBLE_FFT_LEN]; // conjugate spectrum of a segment of each start tone, 1/PREAMBLE_FFT_LEN folded in
+        Float32 pa_template_im[2][PREAMBLE_FFT_LEN];
+        Float32 pa_envelope[SIGNAL_FRAMES]; // generator power over each segment of a slot, weights the segment powers
+#endif
+#ifdef FIXED_POINT_ENABLED
+        int16_t window_q15[SAMPLING_LENGTH]; // half the window, its 2.0 peak would not fit
+        int32_t cosine_q30[CHANNEL_COUNT*FREQ_COUNT];
+#endif
+    } GFT_TABLES;
+    static constexpr GFT_TABLES gft_tables(double rate);
+    static const GFT_TABLES PROTOCOL_GFT_TABLES; // generated at compile time
+    
+    enum {
+        MESSAGE_MAX_BLOCKS = (2*MESSAGE_MAX_LEN+RS_K-1)/RS_K,
+        MESSAGE_MAX_SYMBOLS = (MESSAGE_MAX_BLOCKS*RS_N*4+BITS_PER_SYMBOL-1)/BITS_PER_SYMBOL,
+        MESSAGE_MAX_SIGNAL_LEN = FULL_SIGNAL_LEN+2*MESSAGE_MAX_SYMBOLS,
+    };
+    
+    typedef int AUDIO_DATA[FULL_SIGNAL_LEN];
+    typedef int MESSAGE_DATA[MESSAGE_MAX_SIGNAL_LEN];
+    
+    static constexpr CW_LOOKUP<FREQ_COUNT> CW_ST_TEST_LOOKUP = cw_st_test_lookup<PROFILE>();
+    static constexpr CW_LOOKUP<FREQ_COUNT> CW_DATA_TEST_LOOKUP = cw_data_test_lookup<PROFILE>();
+    
+    // recently decoded code, alive while receptions keep coming within the repeat window
+    typedef struct {
+        unsigned int value;
+        unsigned int hash; // of the payload
+        signed char payload[PAYLOAD_LEN]; // last payload decoding to the value
+        unsigned int seen; // clock of the last reception
+        unsigned int reported; // clock of the last report, 0 if none
+    } RECENT_CODE;
+    
+    // per-stream detector state
+    //
+    // byte budget (FREQ_COUNT=7, HISTORY_LEN=128):
+    //   mags     7*128*4 = 3584 (1792 with DETECTOR_COMPACT_MAGS)
+    //   maxima   128, 1st and 2nd maxima packed as tone index nibbles
+    //   phases   128, phase change flags packed as one bit per freq
+    //   symbols  128, slot pair decisions made as frames arrive
+    //   memo     8*(14+4) = 144, recent payloads and values
+    //   recent   4*32 = 128, decoded codes
+    //   noise    7*6*4 = 168, smoothed power, window minima and floor per freq
+    //   misc     ~90
+    //   total    ~4.5KB (~2.7KB compact), was ~11.6KB of int/float arrays
+    // powers, sums and sum diffs are derived from the mags history on demand
+    typedef struct {
+        DETECTOR_MAG mags[FREQ_COUNT][HISTORY_LEN];
+        unsigned char maxima[HISTORY_LEN];
+        PHASE_FLAGS phases[HISTORY_LEN];
+        signed char symbols[HISTORY_LEN]; // symbol of the slot pair starting at each frame, -1 if none
+        signed char memo[DECODE_MEMO_LEN][PAYLOAD_LEN];
+        unsigned int memo_value[DECODE_MEMO_LEN]; // 0 if RS/CRC failed
+        unsigned char memo_len;
+        unsigned char memo_i; // next memo entry
+        RECENT_CODE recent[RECENT_CODES_LEN];
+        unsigned int clock; // frames since start
+        Float32 p_re[MIC_COUNT][FREQ_COUNT];
+        Float32 p_im[MIC_COUNT][FREQ_COUNT];
+        Float32 mic_floor[MIC_COUNT]; // quietest bin, noise estimate per mic
+        Float32 mic_signal[MIC_COUNT]; // loudest bin above the floor
+        Float32 mic_weight[MIC_COUNT]; // combining weights, sum to 1
+        Float32 noise_power[FREQ_COUNT]; // smoothed frame power
+        Float32 noise_min[FREQ_COUNT][NOISE_WINDOWS]; // power minima, current window first
+        Float32 noise_floor[FREQ_COUNT];
+        short noise_i; // frames into the current window
+        Float32 p_rx_level;
+        Float32 gate_floor[2]; // ST0 tone floors
+        short gate_hold; // frames to keep the bank running
+        short gate_open; // continuously evaluated frames, up to SIGNAL_TEST_FRAME_LEN
+        short frame_i; // next history position, the oldest test frame is SIGNAL_FRAMES ahead
+        short f_skip;
+        unsigned char status;
+        unsigned int pending; // decoded code waiting to be reported
+        unsigned int sic_value; // last cancelled code
+        short sic_hold; // frames its leftovers may still decode
+#ifdef FREQ_TRACK_ENABLED
+        Float32 freq_offset; // Hz, estimated carrier offset
+        Float32 freq_tuned; // Hz, offset the bins are tuned to
+        Float32 freq_rot[2]; // phase advance per block at freq_tuned, cos and sin
+        unsigned char freq_reference; // tone dominating the previous frame + 1, 0 if none
+        unsigned char freq_probes; // frames left to probe
+        Float32 bin_cosine[FREQ_COUNT]; // the channel's bins at freq_tuned, the shared tables serve it while that is 0
+        Float32 bin_sine[FREQ_COUNT];
+#ifdef FIXED_POINT_ENABLED
+        int32_t bin_cosine_q30[FREQ_COUNT];
+#endif
+#endif
+    } DETECTOR_STATE;
+    
+    // framed message receiver, slot pair symbols are collected as they reach the newest frame
+    typedef struct {
+        int length; // bytes
+        int crc;
+        int blocks;
+        int symbols;
+        int symbol;
+        int next; // next slot pair position relative to the newest frame
+#ifdef CLOCK_TRACK_ENABLED
+        Float32 timing; // leaky early/late votes
+#endif
+        signed char data[MESSAGE_MAX_SYMBOLS];
+        unsigned char message[MESSAGE_MAX_LEN]; // decoded message waiting to be reported
+        int message_len;
+    } MESSAGE_RECEIVER;
+    
+    Float32 rx_level; // detecting thread only, other threads read the meter
+#ifdef METERING_ENABLED
+    // level and spectrum, copied out by meter_read from any thread
+    typedef struct {
+        unsigned int block; // blocks since start
+        Float32 level; // rx_level
+        Float32 rms; // input level of the newest block, 0 for batched streams
+        Float32 powers[CHANNEL_COUNT][FREQ_COUNT]; // newest block, 0 for bins the idle gate skipped
+        Float32 peaks[CHANNEL_COUNT][FREQ_COUNT]; // peak hold over the blocks since the last snapshot
+        Float32 noise_floor[CHANNEL_COUNT][FREQ_COUNT];
+    } METER;
+    // detector counters, all channels
+    typedef struct {
+        unsigned int st0_triggers; // start pair rising over the threshold
+        unsigned int st0_rejected; // triggers failing the start pair test
+        unsigned int decode_attempts;
+        unsigned int decode_failures;
+        unsigned int payload_tests; // RS/CRC runs, repeated payloads are not tested again
+        unsigned int repeats_suppressed; // codes received again within the repeat window
+        unsigned int timing_shifts; // slot grid moves following the sender clock, code candidates and messages
+        unsigned int preambles; // start pairs found by the correlator
+        unsigned int preamble_rejected; // energy triggers without one, the decode path didn't run
+        unsigned int decodes_deferred; // candidates left for a later block by the decode budget
+        unsigned int decodes_shed; // candidates dropped from the decode queue, low ranked, full queue or waited too long
+    } DETECTOR_COUNTERS;
+    DETECTOR_COUNTERS counters;
+#endif
     unsigned int result;
+    int result_channel;
+    unsigned char message[MESSAGE_MAX_LEN];
+    int message_len;
+    int message_channel;
+    int repeat_window; // frames a repeated code is not reported again, 0 reports every reception
+#ifdef PREAMBLE_ENABLED
+    double preamble_time; // samples at the decoding rate from the first block to the newest start pair, long before its code decodes
+    Float32 preamble_score;
+    int preamble_channel;
+#endif
     SIGNAL_GENERATOR signal_generator;
-    AudioEx(Float32 sampleRate);
-    ~AudioEx();
-    void gft(Float32 samples[]);
-    void signal_generator_data_from_int(unsigned int value, AUDIO_DATA& data);
+    AudioExT(Float32 sampleRate);
+    ~AudioExT();
+    void gft(SAMPLE samples[]);
+    void process(const Float32 samples[], int count);
+    void set_repeat_window(Float32 seconds);
+#ifdef METERING_ENABLED
+    bool meter_read(METER *snapshot) const;
+#endif
+#ifdef ECHO_CANCEL_ENABLED
+    void echo_reference(const Float32 samples[]);
+#endif
+    void signal_generator_data_from_int(unsigned int value, int data[]);
+    int signal_generator_data_from_bytes(const unsigned char bytes[], int len, int data[]);
     void signal_generator_reset();
-    bool signal_generator_data(AUDIO_DATA& data);
+    bool signal_generator_data(const int data[]);
 private:
     Float32 sample_rate;
-    Float32 gft_coeff_cosine[FREQ_COUNT];
-    Float32 gft_coeff_sine[FREQ_COUNT];
-    Float32 wnd_coeffs[SAMPLING_LENGTH];
+    Float32 capture_rate;
+    RESAMPLER resampler;
+    SAMPLE block[MIC_COUNT*SAMPLING_LENGTH];
+    int block_len;
+    void resampler_init(int in_rate, int out_rate);
+    const GFT_TABLES *tables;
+    GFT_TABLES *custom_tables; // rates running unresampled
     void *rs_codec;
+#ifdef METERING_ENABLED
+    METER meter; // written between odd and even meter_seq
+    unsigned int meter_seq;
+    unsigned int meter_blocks;
+    mutable int meter_wanted; // set by readers, the detector publishes nothing until then
+    bool meter_pending; // snapshot due after this block
+    Float32 meter_rms;
+    bool meter_due();
+    void meter_publish(const Float32 mags2[CHANNEL_COUNT][FREQ_COUNT]);
+#endif
+#ifdef ECHO_CANCEL_ENABLED
+    typedef struct {
+        Float32 r_re[ECHO_TAPS][FREQ_COUNT]; // reference bins, ring of blocks
+        Float32 r_im[ECHO_TAPS][FREQ_COUNT];
+        Float32 x_re[ECHO_LEN]; // reference vector, by block delay and reference bin
+        Float32 x_im[ECHO_LEN];
+        Float32 h_re[MIC_COUNT][FREQ_COUNT][ECHO_LEN]; // echo path per mic and captured bin, kept across broadcasts
+        Float32 h_im[MIC_COUNT][FREQ_COUNT][ECHO_LEN];
+        Float32 p_re[ECHO_LEN][ECHO_LEN]; // inverse correlation of the reference vector
+        Float32 p_im[ECHO_LEN][ECHO_LEN];
+        Float32 p_max; // trace bound, directions our broadcast never excites stop growing
+        Float32 e_re[MIC_COUNT][FREQ_COUNT]; // residual of the current block
+        Float32 e_im[MIC_COUNT][FREQ_COUNT];
+        int bins; // bits of the bins cancelled in the current block
+        int tap; // newest reference block
+        int active; // blocks until the delay line is silent
+        int channel; // TX channel of the reference
+        bool fresh; // reference given for the next block
+    } ECHO_CANCELLER;
+    ECHO_CANCELLER *echo; // NULL in batch lanes
+    void echo_push(const Float32 samples[]);
+    void echo_cancel(int m, int f, Float32* re, Float32* im);
+    void echo_adapt();
+#endif
+#ifdef PREAMBLE_ENABLED
+    // start pair correlator per channel, lags count decimated samples from the first block
+    typedef struct {
+        unsigned int block; // detector frame the first slot ends in, as the oldest test frame counts
+        int type; // ST0 or ST1
+        Float32 score;
+    } PREAMBLE;
+    typedef struct {
+        Float32 lo[2]; // oscillator phase at the next block
+        Float32 in_re[MIC_COUNT][PREAMBLE_FFT_LEN]; // decimated band per mic, the overlap with the previous transform first
+        Float32 in_im[MIC_COUNT][PREAMBLE_FFT_LEN];
+        int in_len;
+        unsigned int lags; // correlated so far
+        Float32 power[2][PREAMBLE_HISTORY_LEN]; // segment correlation power per start tone, by lag, mics combined
+        Float32 energy[PREAMBLE_HISTORY_LEN]; // band energy under the segment, mics combined
+        Float32 slot_power[2][PREAMBLE_HISTORY_LEN]; // summed over the segments of a slot from the lag on
+        Float32 slot_weighted[2][PREAMBLE_HISTORY_LEN]; // the same weighted by the generator envelope
+        Float32 slot_energy[PREAMBLE_HISTORY_LEN];
+        unsigned int scan; // next lag to score
+        unsigned int peak[2]; // lag of the pair being scored that captured the most power, per type, a data slot can look like the other
+        Float32 peak_power[2]; // 0 if none
+        Float32 peak_score[2];
+        PREAMBLE found[PREAMBLE_FOUND];
+        int found_i;
+#ifdef ECHO_CANCEL_ENABLED
+        unsigned int echo_block; // detector clock when our broadcast was last in the band
+#endif
+    } PREAMBLE_CORRELATOR;
+    PREAMBLE_CORRELATOR *preambles; // per channel, NULL in batch lanes
+    template <typename T> void preamble_push(int c, const T samples[]);
+    void preamble_fft(Float32 re[PREAMBLE_FFT_LEN], Float32 im[PREAMBLE_FFT_LEN], bool inverse);
+    void preamble_correlate(int c);
+    void preamble_slot(int c, unsigned int lag);
+    void preamble_pair(int c, unsigned int lag, Float32 score[2], Float32 power[2]);
+    void preamble_found(int c, int type);
+    int preamble_offset(int c, unsigned int block, int type);
+#endif
+#ifdef DECODE_QUEUE_ENABLED
+    // start pair candidate waiting for the decode path
+    typedef struct {
+        AudioExT *stream; // lanes of a batch share one queue
+        int channel;
+        int fft_test_i;
+        unsigned int clock; // detector clock when queued
+        Float32 priority;
+        bool saved; // the offsets were gathered from the history as it was queued, the live history moved on
+        unsigned char offsets; // gathered, up to the first failing the phase test
+        unsigned char usable; // bit per offset, its payload has few enough erasures
+        signed char starts[SIGNAL_TEST_PADDING]; // start pair type at each offset
+        signed char payloads[SIGNAL_TEST_PADDING][PAYLOAD_LEN];
+    } DECODE_JOB;
+    typedef struct {
+        DECODE_JOB jobs[DECODE_QUEUE_LEN];
+        int len;
+    } DECODE_QUEUE;
+    DECODE_QUEUE *decodes;
+    Float32 decode_priority(int fft_test_i, int type);
+    void decode_push(int fft_test_i, Float32 priority);
+    void decode_drain();
+    void decode_gather(DECODE_JOB *job);
+    void decode_saved(DECODE_JOB *job);
+#endif
+    // per channel state, detector and receiver point to the channel being evaluated
+    DETECTOR_STATE detectors[CHANNEL_COUNT];
+    MESSAGE_RECEIVER receivers[CHANNEL_COUNT];
+    DETECTOR_STATE *detector;
+    MESSAGE_RECEIVER *receiver;
+    void goertzel(int f, const Float32 samples[], const Float32 window[], Float32* re, Float32* im);
+    void goertzel_bank(const int bins[], int count, const Float32 samples[], Float32 re[], Float32 im[]);
+#ifdef FIXED_POINT_ENABLED
+    void goertzel_q15(int f, const int32_t samples[], Float32* re, Float32* im);
+    void goertzel_bank_q15(const int bins[], int count, const int32_t samples[], Float32 re[], Float32 im[]);
+#endif
+#ifdef HETERODYNE_ENABLED
+    void heterodyne(int c, const Float32 samples[], Float32 z_re[HETERODYNE_LEN], Float32 z_im[HETERODYNE_LEN]);
+    void goertzel_decimated(int f, const Float32 z_re[HETERODYNE_LEN], const Float32 z_im[HETERODYNE_LEN], Float32* re, Float32* im);
+#endif
+#ifdef IDLE_GATE_ENABLED
+    bool gate_test(const Float32 mags2[FREQ_COUNT]);
+#endif
+#ifdef FREQ_TRACK_ENABLED
+    template <typename T> Float32 freq_probe(Float32 freq, const T samples[]);
+    template <typename T> void freq_track(int c, const T samples[], const Float32 gft_re[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT], const Float32 gft_im[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT], const bool evaluated[FREQ_COUNT]);
+    void freq_tune(int c);
+#endif
+    Float32 frame_mag(int f, int t);
+    DETECTOR_POWER frame_sum_diff(int f, int t);
+    DETECTOR_POWER frame_power(int f, int t);
+    unsigned char frame_maxima(int t);
     unsigned int payload_test(int payload[PAYLOAD_LEN]);
     void cw_lookup_test(const int test[2][2], const int lookup[FREQ_COUNT][FREQ_COUNT], int* t1, int* t2, int* t3, int* t4);
-    bool scoring_test(const Float32 scoring[4][FULL_SIGNAL_LEN], int payload[PAYLOAD_LEN]);
-    bool generate_scoring(int fft_i, const Float32 fft_powers[FREQ_COUNT][SIGNAL_TEST_FRAME_LEN], const int fft_max_powers[2][SIGNAL_TEST_FRAME_LEN], const int fft_phases[FREQ_COUNT][SIGNAL_TEST_FRAME_LEN], Float32 scoring[4][FULL_SIGNAL_LEN]);
-    void detect(Float32 mags[FREQ_COUNT], int phases[FREQ_COUNT]);
+    int symbol_test(const int maxis[2][2], const DETECTOR_POWER energies[2][2]);
+    void frame_symbol(int t);
+    bool phase_test(int fft_i);
+#ifdef CLOCK_TRACK_ENABLED
+    int timing_vote(int t);
+    int timing_track(int t, Float32 *timing);
+#endif
+    bool candidate(int fft_i, int payload[PAYLOAD_LEN]);
+    unsigned int candidate_test(int payload[PAYLOAD_LEN]);
+    unsigned int payload_hash(const int payload[PAYLOAD_LEN]);
+    bool recent_report(unsigned int value);
+    void symbols_from_nibbles(const int nibbles[], int n_nibbles, int symbols[], int n_symbols);
+    int nibbles_from_symbols(const int symbols[], int n_symbols, int nibbles[], int n_nibbles);
+    int start_test(int fft_i);
+    unsigned int decode(int fft_test_i, int* offset);
+    void decode_attempt(int fft_test_i, int t);
+    int decode_center(int fft_test_i, int offset, unsigned int value);
+    bool message_start(unsigned int header, int next);
+    void message_receive(int t);
+    void message_decode();
+#ifdef SIC_ENABLED
+    void cancel(unsigned int value, int fft_i);
+#endif
+    void code_tones(unsigned int value, int data[]);
+    void detect(const Float32 mags[FREQ_COUNT], PHASE_FLAGS phases);
+    void noise_update(const Float32 mags[FREQ_COUNT], int bins);
+    Float32 st0_threshold(int f);
+    void mic_update(const Float32 mags2[MIC_COUNT][FREQ_COUNT], const bool evaluated[FREQ_COUNT]);
+    void report();
+    void detectors_init();
+    // batched front end
+    template <class, int> friend class AudioExBatchT;
+    bool lane; // batch lane, detector state only, its RS codec and decode queue belong to the batch
+    AudioExT(void *codec);
+    void gft_bins(const Float32 re[CHANNEL_COUNT][FREQ_COUNT], const Float32 im[CHANNEL_COUNT][FREQ_COUNT], const Float32 samples[]);
+    void gft_detect(const Float32 gft_re[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT], const Float32 gft_im[MIC_COUNT][CHANNEL_COUNT][FREQ_COUNT], const bool evaluated[CHANNEL_COUNT][FREQ_COUNT]);
 };
+
+typedef AudioExT<PROFILE_DEFAULT> AudioEx;
+
+// lane-per-stream detectors, the same bin of LANES mono streams runs in one vector recurrence
+// streams run at the protocol rate, results are read from each stream like a single AudioEx
+// lanes carry the detector state only, they have no resampler, echo canceller or start pair correlator and
+// share one RS codec, each lane's bins follow its own carrier offset as a single stream's do
+template <class PROFILE, int LANES>
+class AudioExBatchT {
+public:
+    typedef AudioExT<PROFILE> STREAM;
+    enum {
+        SAMPLING_LENGTH = STREAM::SAMPLING_LENGTH,
+        FREQ_COUNT = STREAM::FREQ_COUNT,
+        BINS = STREAM::CHANNEL_COUNT*STREAM::FREQ_COUNT,
+    };
+    static_assert(STREAM::MIC_COUNT == 1, "batched streams are mono");
+    
+    STREAM *streams[LANES];
+    AudioExBatchT();
+    ~AudioExBatchT();
+    void gft(const Float32 samples[]);
+private:
+    alignas(32) Float32 x[SAMPLING_LENGTH][LANES]; // windowed block, frame by frame
+    Float32 re[LANES][BINS];
+    Float32 im[LANES][BINS];
+    void *rs_codec;
+#ifdef DECODE_QUEUE_ENABLED
+    typename STREAM::DECODE_QUEUE *decodes; // candidates of all lanes, ranked together
+#endif
+};
+
+typedef AudioExBatchT<PROFILE_DEFAULT, 8> AudioExBatch;
@@ -6,19 +6,25 @@
 
 #define SAMPLE_RATE 44100.0
 #define AUDIO_BUFFER_LEN 4096
+#define RECORDER_SLOTS 256 // blocks (~3s) the recorder holds while its writer catches up
 
 @interface AudioSessionEx : NSObject
 
 @property (nonatomic, copy) void (^onReceive)(unsigned int);
+@property (nonatomic, copy) void (^onReceiveData)(NSData *);
 @property (nonatomic, copy) void (^onComplete)(BOOL);
 @property (readonly) float RXLevel;
 @property (readonly) float TXLevel;
+@property (readonly) int recorderDropped; // blocks lost by stopped recordings, nonzero means a capture can't be replayed as is
 
 + (AudioSessionEx *)shared;
 
 - (void)setSessionActive:(BOOL)active;
 - (void)startListener:(void(^)(unsigned int code))reception;
 - (void)stopListener;
+- (BOOL)startRecording:(NSString *)path; // blocks fed to the decoder, lossless, for audioexreplay
+- (void)stopRecording;
 - (void)broadcast:(unsigned int)code completion:(void(^)(BOOL success))completion;
+- (void)broadcastData:(NSData *)data completion:(void(^)(BOOL success))completion; // up to MESSAGE_MAX_LEN bytes
 
 @end
@@ -6,18 +6,25 @@
 #import <AudioToolbox/AudioToolbox.h>
 #import "TPCircularBuffer.h"
 #import "AudioEx.h"
+#import "CaptureRecorder.h"
 
 @implementation AudioSessionEx
 {
     AudioComponentInstance inputUnit;
     AudioComponentInstance outputUnit;
     TPCircularBuffer buffer;
+#ifdef ECHO_CANCEL_ENABLED
+    TPCircularBuffer render_buffer; // samples rendered by the output unit
+    TPCircularBuffer echo_buffer; // rendered samples aligned with buffer, echo reference
+#endif
     AudioEx *audio_ex;
+    CaptureRecorder *recorder; // sampler queue only
+    volatile int32_t recorder_dropped; // added from the writer's queue
     BOOL _audio_sampler_active;
     BOOL _audio_session_is_active;
 }
 
-@synthesize onReceive, onComplete, RXLevel, TXLevel;
+@synthesize onReceive, onReceiveData, onComplete, RXLevel, TXLevel;
 
 + (AudioSessionEx *)shared
 {
@@ -41,7 +48,7 @@
     return _queue;
 }
 
-static AUDIO_DATA audio_data;
+static AudioEx::MESSAGE_DATA audio_data;
 
 static inline OSStatus AudioOutputCallback(void *inRefCon, AudioUnitRenderActionFlags *ioActionFlags, const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList *ioData)
 {
@@ -74,6 +81,15 @@ static inline OSStatus AudioOutputCallback(void *inRefCon, AudioUnitRenderAction
             generating = THIS->audio_ex->signal_generator_data(audio_data);
         }
     }
+#ifdef ECHO_CANCEL_ENABLED
+    int32_t availableBytes = 0;
+    Float32 *rendered = (Float32 *)TPCircularBufferHead(&THIS->render_buffer, &availableBytes);
+    if (rendered && availableBytes >= (int32_t)(inNumberFrames * sizeof(Float32)))
+    {
+        for (UInt32 i = 0; i < inNumberFrames; i++) rendered[i] = (Float32)targetBuffer[i] / INT16_MAX;
+        TPCircularBufferProduce(&THIS->render_buffer, inNumberFrames * sizeof(Float32));
+    }
+#endif
     if (!generating)
     {
         AudioOutputUnitStop(THIS->outputUnit);
@@ -145,7 +161,25 @@ static inline OSStatus AudioInputCallback(void *inRefCon, AudioUnitRenderActionF
 	bufferList.mNumberBuffers = 1;
 	bufferList.mBuffers[0] = buffer;
     OSStatus err = AudioUnitRender(THIS->inputUnit, ioActionFlags, inTimeStamp, inBusNumber, inNumberFrames, &bufferList);
-    if (!err) TPCircularBufferProduceBytes(&THIS->buffer, bufferList.mBuffers[0].mData, buffer.mDataByteSize);
+    if (!err)
+    {
+        TPCircularBufferProduceBytes(&THIS->buffer, bufferList.mBuffers[0].mData, buffer.mDataByteSize);
+#ifdef ECHO_CANCEL_ENABLED
+        // what was rendered meanwhile goes next to the captured samples, silence if nothing was
+        int32_t renderedBytes = 0;
+        Float32 *rendered = (Float32 *)TPCircularBufferTail(&THIS->render_buffer, &renderedBytes);
+        renderedBytes = MIN(renderedBytes, (int32_t)buffer.mDataByteSize);
+        int32_t availableBytes = 0;
+        Float32 *echo = (Float32 *)TPCircularBufferHead(&THIS->echo_buffer, &availableBytes);
+        if (echo && availableBytes >= (int32_t)buffer.mDataByteSize)
+        {
+            if (renderedBytes > 0) memcpy(echo, rendered, renderedBytes);
+            memset((char *)echo + renderedBytes, 0, buffer.mDataByteSize - renderedBytes);
+            TPCircularBufferProduce(&THIS->echo_buffer, buffer.mDataByteSize);
+        }
+        if (renderedBytes > 0) TPCircularBufferConsume(&THIS->render_buffer, renderedBytes);
+#endif
+    }
     else printf("Error sampling audio data\n"); // DEBUG
     free(bufferList.mBuffers[0].mData);
     return err;
@@ -186,7 +220,18 @@ static inline OSStatus AudioInputCallback(void *inRefCon, AudioUnitRenderActionF
 
 - (float)RXLevel
 {
-    return audio_ex->rx_level;
+#ifdef METERING_ENABLED
+    // rx_level belongs to the sampler queue, the meter is safe from here
+    AudioEx::METER meter;
+    return audio_ex->meter_read(&meter) ? meter.level : 0.0;
+#else
+    return 0.0;
+#endif
+}
+
+- (int)recorderDropped
+{
+    return recorder_dropped;
 }
 
 - (float)TXLevel
@@ -204,6 +249,10 @@ static inline OSStatus AudioInputCallback(void *inRefCon, AudioUnitRenderActionF
         [self _createAudioInputUnit];
         [self _createAudioOutputUnit];
         TPCircularBufferInit(&buffer, AUDIO_BUFFER_LEN);
+#ifdef ECHO_CANCEL_ENABLED
+        TPCircularBufferInit(&render_buffer, AUDIO_BUFFER_LEN);
+        TPCircularBufferInit(&echo_buffer, AUDIO_BUFFER_LEN);
+#endif
         audio_ex = new AudioEx(SAMPLE_RATE);
     }
     return self;
@@ -240,13 +289,39 @@ static inline OSStatus AudioInputCallback(void *inRefCon, AudioUnitRenderActionF
         int32_t availableSamples = availableBytes / sizeof(Float32);
         // DEBUG
         //printf("%i\n", availableSamples);
-        if (availableSamples >= SAMPLING_LENGTH)
+        if (availableSamples >= AudioEx::SAMPLING_LENGTH)
         {
+#ifdef ECHO_CANCEL_ENABLED
+            int32_t echoBytes = 0;
+            Float32 *echo = (Float32 *)TPCircularBufferTail(&echo_buffer, &echoBytes);
+            BOOL reference = echo && echoBytes >= (int32_t)(AudioEx::SAMPLING_LENGTH * sizeof(Float32));
+#endif
             static int samples_count = 0;
             if (samples_count < IPHONE5_AUDIO_INPUT_LAG) samples_count++;
-            else audio_ex->gft(samples);
+            else
+            {
+#ifdef ECHO_CANCEL_ENABLED
+                if (reference) audio_ex->echo_reference(echo);
+#endif
+#ifdef FIXED_POINT_ENABLED
+                SAMPLE block[AudioEx::SAMPLING_LENGTH];
+                for (int i=0; i<AudioEx::SAMPLING_LENGTH; i++) block[i] = sample_pack(samples[i]);
+#else
+                SAMPLE *block = samples;
+#endif
+                // exactly what gft gets, before it windows the block in place
+#ifdef ECHO_CANCEL_ENABLED
+                if (recorder) CaptureRecorderTap(recorder, block, reference ? echo : NULL);
+#else
+                if (recorder) CaptureRecorderTap(recorder, block, NULL);
+#endif
+                audio_ex->gft(block);
+            }
             
-            TPCircularBufferConsume(&buffer, SAMPLING_LENGTH * sizeof(Float32));
+            TPCircularBufferConsume(&buffer, AudioEx::SAMPLING_LENGTH * sizeof(Float32));
+#ifdef ECHO_CANCEL_ENABLED
+            if (reference) TPCircularBufferConsume(&echo_buffer, AudioEx::SAMPLING_LENGTH * sizeof(Float32));
+#endif
         }
         if (audio_ex->result > 0)
         {
@@ -257,6 +332,15 @@ static inline OSStatus AudioInputCallback(void *inRefCon, AudioUnitRenderActionF
             }
             audio_ex->result = 0;
         }
+        if (audio_ex->message_len > 0)
+        {
+            if (self.onReceiveData)
+            {
+                NSData *data = [NSData dataWithBytes:audio_ex->message length:audio_ex->message_len];
+                dispatch_async([AudioSessionEx queue], ^{ self.onReceiveData(data); });
+            }
+            audio_ex->message_len = 0;
+        }
         if (_audio_sampler_active) [self _audio_sampler];
     });
 }
@@ -282,6 +366,34 @@ static inline OSStatus AudioInputCallback(void *inRefCon, AudioUnitRenderActionF
     }
 }
 
+- (BOOL)startRecording:(NSString *)path
+{
+    CaptureRecorder *started = CaptureRecorderStart([path fileSystemRepresentation], SAMPLE_RATE, AudioEx::SAMPLING_LENGTH, sizeof(SAMPLE), RECORDER_SLOTS);
+    if (!started) return NO;
+    dispatch_async([AudioSessionEx queue], ^{
+        CaptureRecorder *previous = recorder;
+        recorder = started;
+        // the writer drains off the sampler queue
+        if (previous) dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+            int32_t dropped = CaptureRecorderStop(previous);
+            if (dropped > 0) __sync_fetch_and_add(&recorder_dropped, dropped);
+        });
+    });
+    return YES;
+}
+
+- (void)stopRecording
+{
+    dispatch_async([AudioSessionEx queue], ^{
+        CaptureRecorder *previous = recorder;
+        recorder = NULL;
+        if (previous) dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+            int32_t dropped = CaptureRecorderStop(previous);
+            if (dropped > 0) __sync_fetch_and_add(&recorder_dropped, dropped);
+        });
+    });
+}
+
 - (void)broadcast:(unsigned int)code completion:(void(^)(BOOL success))completion
 {
     self.onComplete = completion;
@@ -298,6 +410,21 @@ static inline OSStatus AudioInputCallback(void *inRefCon, AudioUnitRenderActionF
     }
 }
 
+- (void)broadcastData:(NSData *)data completion:(void(^)(BOOL success))completion
+{
+    self.onComplete = completion;
+    if (outputUnit && audio_ex->signal_generator_data_from_bytes((const unsigned char *)data.bytes, (int)data.length, audio_data) > 0)
+    {
+        AudioOutputUnitStart(outputUnit);
+    } else {
+        if (self.onComplete)
+        {
+            self.onComplete(NO);
+            self.onComplete = nil;
+        }
+    }
+}
+
 - (void)dealloc
 {
     [self setSessionActive:NO];
@@ -313,7 +440,12 @@ static inline OSStatus AudioInputCallback(void *inRefCon, AudioUnitRenderActionF
         AudioUnitUninitialize(outputUnit);
         AudioComponentInstanceDispose(outputUnit);
     }
+    if (recorder) CaptureRecorderStop(recorder);
     TPCircularBufferCleanup(&buffer);
+#ifdef ECHO_CANCEL_ENABLED
+    TPCircularBufferCleanup(&render_buffer);
+    TPCircularBufferCleanup(&echo_buffer);
+#endif
     delete[] audio_ex;
     [super dealloc];
 }
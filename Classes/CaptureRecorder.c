@@ -0,0 +1,400 @@
+//
+//  CaptureRecorder.c
+//  Lossless recording of the blocks fed to the decoder, and reading them back for replay
+//
+
+#include "CaptureRecorder.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CAPTURE_FLAG_ECHO 0x01
+#define CAPTURE_FLAG_GAP 0x02
+
+#define CODING_VERBATIM 0
+#define CODING_RICE 1
+
+#define RICE_ESCAPE 24 // quotients this long are written as the raw 32 bit value instead
+#define FLOAT_GRID 8388608.0f // 2^23, 24 bit capture
+#define INT_LIMIT (1 << 24) // integer coded samples stay below this, order 2 residuals fit 27 bits
+
+#define WRITER_IDLE_NS 10000000L // 10ms, under a block at 44.1kHz
+
+typedef struct {
+    int32_t gap;
+    bool    hasEcho;
+} SLOT_HEADER;
+
+struct CaptureRecorder {
+    FILE           *file;
+    CaptureHeader   header;
+    uint8_t        *slots;          // slotCount slots of SLOT_HEADER, samples, echo
+    int32_t         slotSize;
+    int32_t         slotCount;
+    volatile int32_t head;          // tap only
+    volatile int32_t tail;          // writer only
+    volatile int32_t running;
+    int32_t         pendingGap;     // tap only
+    int32_t         dropped;        // tap only
+    pthread_t       writer;
+    // writer scratch
+    int32_t        *values;
+    uint8_t        *payload;
+    int32_t         payloadLength;
+};
+
+// bit writer / reader
+
+typedef struct {
+    uint8_t *data;
+    int32_t  length;
+    int32_t  position; // bytes
+    uint64_t bits;
+    int      count;
+    bool     overflow;
+} BIT_WRITER;
+
+static void _bits_put(BIT_WRITER *w, uint32_t value, int count) {
+    w->bits = (w->bits << count) | (value & ((count == 32) ? 0xFFFFFFFFu : ((1u << count) - 1)));
+    w->count += count;
+    while ( w->count >= 8 ) {
+        w->count -= 8;
+        if ( w->position < w->length ) w->data[w->position++] = (uint8_t)(w->bits >> w->count);
+        else w->overflow = true;
+    }
+}
+
+static int32_t _bits_flush(BIT_WRITER *w) {
+    if ( w->count > 0 ) _bits_put(w, 0, 8 - w->count);
+    return w->position;
+}
+
+typedef struct {
+    const uint8_t *data;
+    int32_t  length;
+    int32_t  position;
+    uint64_t bits;
+    int      count;
+    bool     underflow;
+} BIT_READER;
+
+static uint32_t _bits_get(BIT_READER *r, int count) {
+    while ( r->count < count ) {
+        uint8_t byte = 0;
+        if ( r->position < r->length ) byte = r->data[r->position++];
+        else r->underflow = true;
+        r->bits = (r->bits << 8) | byte;
+        r->count += 8;
+    }
+    r->count -= count;
+    return (uint32_t)(r->bits >> r->count) & ((count == 32) ? 0xFFFFFFFFu : ((1u << count) - 1));
+}
+
+// block coding
+
+static bool _integers(const void *samples, int32_t sampleSize, int32_t length, int32_t *values) {
+    if ( sampleSize == 2 ) {
+        for ( int i = 0; i < length; i++ ) values[i] = ((const int16_t *)samples)[i];
+        return true;
+    }
+    // Float32 on the 2^-23 grid, bit for bit, -0 and anything off the grid is left verbatim
+    const float *x = (const float *)samples;
+    for ( int i = 0; i < length; i++ ) {
+        float scaled = x[i] * FLOAT_GRID;
+        if ( !(scaled > -INT_LIMIT && scaled < INT_LIMIT) ) return false;
+        int32_t value = (int32_t)scaled;
+        float back = (float)value / FLOAT_GRID;
+        if ( memcmp(&back, &x[i], sizeof(float)) != 0 ) return false;
+        values[i] = value;
+    }
+    return true;
+}
+
+static inline int32_t _residual(const int32_t *values, int i, int order) {
+    if ( order > i ) order = i;
+    switch ( order ) {
+        case 0: return values[i];
+        case 1: return values[i] - values[i-1];
+        default: return values[i] - 2 * values[i-1] + values[i-2];
+    }
+}
+
+static inline uint32_t _zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t _unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// codes one channel into payload, returns its length
+static int32_t _encode(const void *samples, int32_t sampleSize, int32_t length, int32_t *values, uint8_t *payload, int32_t payloadLength) {
+    int32_t verbatim = length * sampleSize;
+    if ( _integers(samples, sampleSize, length, values) ) {
+        // low bits zero in every sample (16 bit capture on the 24 bit grid) are not coded
+        uint32_t bits = 0;
+        for ( int i = 0; i < length; i++ ) bits |= (uint32_t)values[i];
+        int shift = 0;
+        while ( bits != 0 && shift < 31 && !(bits & (1u << shift)) ) shift++;
+        if ( shift > 0 ) for ( int i = 0; i < length; i++ ) values[i] >>= shift;
+
+        // fixed predictor with the smallest residuals, Rice parameter from their mean
+        uint64_t sums[3] = { 0, 0, 0 };
+        for ( int i = 0; i < length; i++ ) {
+            for ( int order = 0; order < 3; order++ ) sums[order] += _zigzag(_residual(values, i, order));
+        }
+        int order = 0;
+        for ( int o = 1; o < 3; o++ ) if ( sums[o] < sums[order] ) order = o;
+        uint64_t mean = sums[order] / (uint64_t)length;
+        int k = 0;
+        while ( k < 31 && ((uint64_t)1 << (k + 1)) <= mean ) k++;
+
+        BIT_WRITER w = { payload, payloadLength, 0, 0, 0, false };
+        _bits_put(&w, CODING_RICE, 8);
+        _bits_put(&w, (uint32_t)order, 8);
+        _bits_put(&w, (uint32_t)k, 8);
+        _bits_put(&w, (uint32_t)shift, 8);
+        for ( int i = 0; i < length && !w.overflow; i++ ) {
+            uint32_t u = _zigzag(_residual(values, i, order));
+            uint32_t q = u >> k;
+            if ( q < RICE_ESCAPE ) {
+                _bits_put(&w, (1u << (q + 1)) - 2, (int)q + 1); // q ones, a zero
+                if ( k > 0 ) _bits_put(&w, u, k);
+            } else {
+                _bits_put(&w, (1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+                _bits_put(&w, u, 32);
+            }
+        }
+        int32_t coded = _bits_flush(&w);
+        if ( !w.overflow && coded < verbatim + 1 ) return coded;
+    }
+
+    payload[0] = CODING_VERBATIM;
+    memcpy(payload + 1, samples, verbatim);
+    return verbatim + 1;
+}
+
+static bool _decode(const uint8_t *payload, int32_t payloadLength, int32_t sampleSize, int32_t length, void *samples) {
+    if ( payloadLength < 1 ) return false;
+    if ( payload[0] == CODING_VERBATIM ) {
+        if ( payloadLength != length * sampleSize + 1 ) return false;
+        memcpy(samples, payload + 1, length * sampleSize);
+        return true;
+    }
+    if ( payload[0] != CODING_RICE || payloadLength < 4 ) return false;
+
+    BIT_READER r = { payload, payloadLength, 1, 0, 0, false };
+    int order = (int)_bits_get(&r, 8);
+    int k = (int)_bits_get(&r, 8);
+    int shift = (int)_bits_get(&r, 8);
+    if ( order > 2 || k > 31 || shift > 31 ) return false;
+
+    int32_t previous[2] = { 0, 0 }; // values[i-1], values[i-2]
+    for ( int i = 0; i < length; i++ ) {
+        uint32_t q = 0;
+        while ( q < RICE_ESCAPE && _bits_get(&r, 1) ) q++;
+        uint32_t u = (q < RICE_ESCAPE) ? ((q << k) | (k > 0 ? _bits_get(&r, k) : 0)) : _bits_get(&r, 32);
+        int32_t residual = _unzigzag(u);
+        int o = (order > i) ? i : order;
+        int32_t value = (o == 0) ? residual : (o == 1) ? residual + previous[0] : residual + 2 * previous[0] - previous[1];
+        previous[1] = previous[0];
+        previous[0] = value;
+        int32_t sample = (int32_t)((uint32_t)value << shift);
+        if ( sampleSize == 2 ) ((int16_t *)samples)[i] = (int16_t)sample;
+        else ((float *)samples)[i] = (float)sample / FLOAT_GRID;
+    }
+    return !r.underflow;
+}
+
+// file
+
+static void _put32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value; p[1] = (uint8_t)(value >> 8); p[2] = (uint8_t)(value >> 16); p[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t _get32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void _write_channel(CaptureRecorder *recorder, const void *samples, int32_t sampleSize) {
+    int32_t coded = _encode(samples, sampleSize, recorder->header.blockLength, recorder->values, recorder->payload, recorder->payloadLength);
+    uint8_t length[4];
+    _put32(length, (uint32_t)coded);
+    fwrite(length, 4, 1, recorder->file);
+    fwrite(recorder->payload, coded, 1, recorder->file);
+}
+
+static void _write_slot(CaptureRecorder *recorder, const uint8_t *slot) {
+    const SLOT_HEADER *header = (const SLOT_HEADER *)slot;
+    const uint8_t *samples = slot + sizeof(SLOT_HEADER);
+    const uint8_t *echo = samples + recorder->header.blockLength * recorder->header.sampleSize;
+
+    uint8_t record[5];
+    int recordLength = 1;
+    record[0] = (header->hasEcho ? CAPTURE_FLAG_ECHO : 0) | (header->gap > 0 ? CAPTURE_FLAG_GAP : 0);
+    if ( header->gap > 0 ) {
+        _put32(record + 1, (uint32_t)header->gap);
+        recordLength += 4;
+    }
+    fwrite(record, recordLength, 1, recorder->file);
+    _write_channel(recorder, samples, recorder->header.sampleSize);
+    if ( header->hasEcho ) _write_channel(recorder, echo, sizeof(float));
+}
+
+static void* _writer(void *arg) {
+    CaptureRecorder *recorder = (CaptureRecorder *)arg;
+    struct timespec idle = { 0, WRITER_IDLE_NS };
+
+    for ( ;; ) {
+        int32_t head = __atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE);
+        if ( recorder->tail == head ) {
+            if ( !__atomic_load_n(&recorder->running, __ATOMIC_ACQUIRE) && head == __atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE) ) break;
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        _write_slot(recorder, recorder->slots + (size_t)(recorder->tail % recorder->slotCount) * recorder->slotSize);
+        __atomic_store_n(&recorder->tail, recorder->tail + 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+CaptureRecorder* CaptureRecorderStart(const char *path, int32_t sampleRate, int32_t blockLength, int32_t sampleSize, int32_t slots) {
+    if ( (sampleSize != 2 && sampleSize != 4) || blockLength <= 0 || slots <= 0 ) return NULL;
+
+    CaptureRecorder *recorder = (CaptureRecorder *)calloc(1, sizeof(CaptureRecorder));
+    if ( !recorder ) return NULL;
+    recorder->header.magic = CAPTURE_MAGIC;
+    recorder->header.version = CAPTURE_VERSION;
+    recorder->header.sampleSize = (uint16_t)sampleSize;
+    recorder->header.sampleRate = sampleRate;
+    recorder->header.blockLength = blockLength;
+    recorder->slotSize = (int32_t)sizeof(SLOT_HEADER) + blockLength * (sampleSize + (int32_t)sizeof(float));
+    recorder->slotSize = (recorder->slotSize + 15) & ~15;
+    recorder->slotCount = slots;
+    recorder->payloadLength = blockLength * (int32_t)sizeof(float) + 1;
+    recorder->slots = (uint8_t *)malloc((size_t)recorder->slotSize * slots);
+    recorder->values = (int32_t *)malloc(blockLength * sizeof(int32_t));
+    recorder->payload = (uint8_t *)malloc(recorder->payloadLength);
+    recorder->file = fopen(path, "wb");
+    if ( !recorder->slots || !recorder->values || !recorder->payload || !recorder->file ) {
+        if ( recorder->file ) fclose(recorder->file);
+        free(recorder->slots);
+        free(recorder->values);
+        free(recorder->payload);
+        free(recorder);
+        return NULL;
+    }
+
+    uint8_t header[16];
+    _put32(header, recorder->header.magic);
+    _put32(header + 4, recorder->header.version | ((uint32_t)recorder->header.sampleSize << 16));
+    _put32(header + 8, (uint32_t)recorder->header.sampleRate);
+    _put32(header + 12, (uint32_t)recorder->header.blockLength);
+    fwrite(header, sizeof header, 1, recorder->file);
+
+    recorder->running = 1;
+    if ( pthread_create(&recorder->writer, NULL, _writer, recorder) != 0 ) {
+        fclose(recorder->file);
+        free(recorder->slots);
+        free(recorder->values);
+        free(recorder->payload);
+        free(recorder);
+        return NULL;
+    }
+
+    return recorder;
+}
+
+bool CaptureRecorderTap(CaptureRecorder *recorder, const void *samples, const float *echo) {
+    int32_t head = recorder->head;
+    if ( head - __atomic_load_n(&recorder->tail, __ATOMIC_ACQUIRE) >= recorder->slotCount ) {
+        recorder->pendingGap++;
+        recorder->dropped++;
+        return false;
+    }
+
+    uint8_t *slot = recorder->slots + (size_t)(head % recorder->slotCount) * recorder->slotSize;
+    SLOT_HEADER *header = (SLOT_HEADER *)slot;
+    uint8_t *data = slot + sizeof(SLOT_HEADER);
+    int32_t samplesBytes = recorder->header.blockLength * recorder->header.sampleSize;
+    header->gap = recorder->pendingGap;
+    header->hasEcho = (echo != NULL);
+    memcpy(data, samples, samplesBytes);
+    if ( echo ) memcpy(data + samplesBytes, echo, recorder->header.blockLength * sizeof(float));
+    recorder->pendingGap = 0;
+
+    __atomic_store_n(&recorder->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+int32_t CaptureRecorderStop(CaptureRecorder *recorder) {
+    __atomic_store_n(&recorder->running, 0, __ATOMIC_RELEASE);
+    pthread_join(recorder->writer, NULL);
+
+    int32_t dropped = recorder->dropped;
+    fclose(recorder->file);
+    free(recorder->slots);
+    free(recorder->values);
+    free(recorder->payload);
+    free(recorder);
+    return dropped;
+}
+
+bool CaptureReaderOpen(CaptureReader *reader, const char *path) {
+    memset(reader, 0, sizeof(CaptureReader));
+    reader->file = fopen(path, "rb");
+    if ( !reader->file ) return false;
+
+    uint8_t header[16];
+    if ( fread(header, sizeof header, 1, reader->file) != 1 ) goto fail;
+    reader->header.magic = _get32(header);
+    reader->header.version = (uint16_t)_get32(header + 4);
+    reader->header.sampleSize = (uint16_t)(_get32(header + 4) >> 16);
+    reader->header.sampleRate = (int32_t)_get32(header + 8);
+    reader->header.blockLength = (int32_t)_get32(header + 12);
+    if ( reader->header.magic != CAPTURE_MAGIC || reader->header.version != CAPTURE_VERSION ) goto fail;
+    if ( (reader->header.sampleSize != 2 && reader->header.sampleSize != 4) || reader->header.blockLength <= 0 ) goto fail;
+
+    reader->payloadLength = reader->header.blockLength * (int32_t)sizeof(float) + 1;
+    reader->payload = (uint8_t *)malloc(reader->payloadLength);
+    if ( !reader->payload ) goto fail;
+    return true;
+
+fail:
+    fclose(reader->file);
+    reader->file = NULL;
+    return false;
+}
+
+static bool _read_channel(CaptureReader *reader, int32_t sampleSize, void *samples) {
+    uint8_t length[4];
+    if ( fread(length, 4, 1, reader->file) != 1 ) return false;
+    int32_t coded = (int32_t)_get32(length);
+    if ( coded <= 0 || coded > reader->payloadLength ) return false;
+    if ( fread(reader->payload, coded, 1, reader->file) != 1 ) return false;
+    return _decode(reader->payload, coded, sampleSize, reader->header.blockLength, samples);
+}
+
+int CaptureReaderNext(CaptureReader *reader, void *samples, float *echo, bool *hasEcho, int32_t *gap) {
+    int flags = fgetc(reader->file);
+    if ( flags == EOF ) return 0;
+
+    *gap = 0;
+    if ( flags & CAPTURE_FLAG_GAP ) {
+        uint8_t count[4];
+        if ( fread(count, 4, 1, reader->file) != 1 ) return -1;
+        *gap = (int32_t)_get32(count);
+    }
+    *hasEcho = (flags & CAPTURE_FLAG_ECHO) != 0;
+    if ( !_read_channel(reader, reader->header.sampleSize, samples) ) return -1;
+    if ( *hasEcho && !_read_channel(reader, sizeof(float), echo) ) return -1;
+    return 1;
+}
+
+void CaptureReaderClose(CaptureReader *reader) {
+    if ( reader->file ) fclose(reader->file);
+    free(reader->payload);
+    memset(reader, 0, sizeof(CaptureReader));
+}
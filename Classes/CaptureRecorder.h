@@ -0,0 +1,106 @@
+//
+//  CaptureRecorder.h
+//  Lossless recording of the blocks fed to the decoder, and reading them back for replay
+//
+//  The tap copies a block into a fixed ring of preallocated slots and returns, a background
+//  thread encodes and writes. A full ring drops the block and the next record notes the gap,
+//  the tap never blocks or allocates.
+//
+//  Blocks are coded one by one: samples that are exact integers (int16, or Float32 on a 2^-23
+//  grid as capture hardware delivers them) go through a fixed 0-2 order predictor and Rice codes,
+//  anything else is stored verbatim, so decoding always returns the same bits.
+//
+//  File: header, then per block a flags byte (echo reference present, gap), an optional gap
+//  count, and one coded channel for the samples plus one for the echo reference. Little-endian.
+//
+
+#ifndef CaptureRecorder_h
+#define CaptureRecorder_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_MAGIC 0x43584541 // "AEXC"
+#define CAPTURE_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sampleSize;   // bytes per sample, 2 int16, 4 Float32, echo references are always Float32
+    int32_t  sampleRate;
+    int32_t  blockLength;  // samples per block
+} CaptureHeader;
+
+typedef struct CaptureRecorder CaptureRecorder;
+
+/*!
+ * Start recording
+ *
+ *  Opens the file, allocates the ring and starts the writer thread.
+ *
+ * @param path File to write
+ * @param sampleRate Rate of the recorded samples
+ * @param blockLength Samples per block
+ * @param sampleSize Bytes per sample, 2 or 4
+ * @param slots Blocks the ring holds while the writer catches up
+ * @return The recorder, NULL on failure
+ */
+CaptureRecorder* CaptureRecorderStart(const char *path, int32_t sampleRate, int32_t blockLength, int32_t sampleSize, int32_t slots);
+
+/*!
+ * Record a block
+ *
+ *  Call before the block is handed to the decoder, gft windows it in place.
+ *
+ * @param recorder Recorder
+ * @param samples blockLength samples
+ * @param echo blockLength Float32 echo reference samples, or NULL
+ * @return false if the ring was full and the block dropped
+ */
+bool CaptureRecorderTap(CaptureRecorder *recorder, const void *samples, const float *echo);
+
+/*!
+ * Stop recording
+ *
+ *  Writes what is left in the ring, joins the writer and closes the file.
+ *
+ * @return Blocks dropped over the whole recording
+ */
+int32_t CaptureRecorderStop(CaptureRecorder *recorder);
+
+typedef struct {
+    FILE          *file;
+    CaptureHeader  header;
+    uint8_t       *payload;    // one coded channel
+    int32_t        payloadLength;
+} CaptureReader;
+
+/*!
+ * Open a recording
+ */
+bool CaptureReaderOpen(CaptureReader *reader, const char *path);
+
+/*!
+ * Read the next block
+ *
+ * @param reader Reader
+ * @param samples On output, blockLength samples
+ * @param echo On output, blockLength echo reference samples if one was recorded
+ * @param hasEcho On output, whether echo was filled
+ * @param gap On output, blocks dropped by the recorder right before this one
+ * @return 1 for a block, 0 at the end, -1 if the file is damaged
+ */
+int CaptureReaderNext(CaptureReader *reader, void *samples, float *echo, bool *hasEcho, int32_t *gap);
+
+void CaptureReaderClose(CaptureReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,5 +7,7 @@ extern "C"
     void *init_rs_char(unsigned int symsize,unsigned int gfpoly,unsigned int fcr,unsigned int prim,unsigned int nroots);
     void free_rs_char(void *rs);
     
+    unsigned char crc8(const char *buf, int len);
     unsigned char crc8_int(unsigned int data);
+    unsigned char crc8_nibbles(const unsigned char *nibbles, int len);
 }
\ No newline at end of file
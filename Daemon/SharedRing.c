@@ -0,0 +1,147 @@
+//
+//  SharedRing.c
+//  Cross-process single producer / single consumer ring in shared memory
+//
+
+#include "SharedRing.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static int32_t _page_size(void) {
+    return (int32_t)sysconf(_SC_PAGESIZE);
+}
+
+static bool _map(SharedRing *ring) {
+    int32_t page = _page_size();
+
+    ring->header = (SharedRingHeader *)mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if ( ring->header == MAP_FAILED ) {
+        perror("SharedRing: map header");
+        ring->header = NULL;
+        return false;
+    }
+
+    // reserve twice the data length, then map the data pages into both halves
+    char *address = (char *)mmap(NULL, 2 * ring->length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( address == MAP_FAILED ) {
+        perror("SharedRing: reserve");
+        munmap(ring->header, page);
+        ring->header = NULL;
+        return false;
+    }
+    for ( int i = 0; i < 2; i++ ) {
+        if ( mmap(address + i * ring->length, ring->length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, ring->fd, page) == MAP_FAILED ) {
+            perror("SharedRing: map data");
+            munmap(address, 2 * ring->length);
+            munmap(ring->header, page);
+            ring->header = NULL;
+            return false;
+        }
+    }
+    ring->buffer = address;
+
+    return true;
+}
+
+bool SharedRingCreate(SharedRing *ring, const char *name, int32_t length, int32_t sampleRate) {
+    memset(ring, 0, sizeof(SharedRing));
+    strncpy(ring->name, name, sizeof(ring->name) - 1);
+
+    int32_t page = _page_size();
+    ring->length = (length + page - 1) / page * page;    // We need whole page sizes
+
+    ring->fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0660);
+    if ( ring->fd < 0 ) {
+        perror("SharedRing: shm_open");
+        return false;
+    }
+    if ( ftruncate(ring->fd, page + ring->length) != 0 ) {
+        perror("SharedRing: ftruncate");
+        close(ring->fd);
+        shm_unlink(name);
+        return false;
+    }
+    if ( !_map(ring) ) {
+        close(ring->fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    ring->header->length = ring->length;
+    ring->header->sampleRate = sampleRate;
+    __atomic_store_n(&ring->header->magic, SHARED_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool SharedRingOpen(SharedRing *ring, const char *name) {
+    memset(ring, 0, sizeof(SharedRing));
+    strncpy(ring->name, name, sizeof(ring->name) - 1);
+
+    ring->fd = shm_open(name, O_RDWR, 0);
+    if ( ring->fd < 0 ) {
+        perror("SharedRing: shm_open");
+        return false;
+    }
+
+    // length from the control block of the creator
+    SharedRingHeader header;
+    if ( pread(ring->fd, &header, sizeof header, 0) != sizeof header || header.magic != SHARED_RING_MAGIC ) {
+        fprintf(stderr, "SharedRing: %s is not a ring\n", name);
+        close(ring->fd);
+        return false;
+    }
+    ring->length = header.length;
+
+    if ( !_map(ring) ) {
+        close(ring->fd);
+        return false;
+    }
+
+    return true;
+}
+
+void SharedRingClose(SharedRing *ring, bool unlink) {
+    if ( ring->header ) {
+        munmap(ring->buffer, 2 * ring->length);
+        munmap(ring->header, _page_size());
+        ring->header = NULL;
+        ring->buffer = NULL;
+    }
+    if ( ring->fd >= 0 ) close(ring->fd);
+    ring->fd = -1;
+    if ( unlink ) shm_unlink(ring->name);
+}
+
+bool SharedRingWait(SharedRing *ring, int32_t bytes, int timeoutMs) {
+    SharedRingHeader *header = ring->header;
+    struct timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+
+    while ( __atomic_load_n(&header->fillCount, __ATOMIC_SEQ_CST) < bytes ) {
+        // sample the futex word before announcing the wait, a produce after this makes the wait return at once
+        int32_t produced = __atomic_load_n(&header->produced, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&header->waiting, 1, __ATOMIC_SEQ_CST);
+        if ( __atomic_load_n(&header->fillCount, __ATOMIC_SEQ_CST) >= bytes ) break;
+
+        long result = syscall(SYS_futex, &header->produced, FUTEX_WAIT, produced, timeoutMs < 0 ? NULL : &timeout, NULL, 0);
+        if ( result != 0 && errno == ETIMEDOUT ) {
+            __atomic_store_n(&header->waiting, 0, __ATOMIC_SEQ_CST);
+            return __atomic_load_n(&header->fillCount, __ATOMIC_SEQ_CST) >= bytes;
+        }
+    }
+    __atomic_store_n(&header->waiting, 0, __ATOMIC_SEQ_CST);
+
+    return true;
+}
+
+void SharedRingWake(SharedRing *ring) {
+    syscall(SYS_futex, &ring->header->produced, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
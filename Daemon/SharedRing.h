@@ -0,0 +1,141 @@
+//
+//  SharedRing.h
+//  Cross-process single producer / single consumer ring in shared memory
+//
+//  Same head/tail/fillCount scheme as TPCircularBuffer, with the control block and the data
+//  living in a POSIX shared memory object so a producer process can write PCM straight into
+//  memory the decoder reads. The data pages are mapped twice back to back in each process, so
+//  either side gets contiguous space without wrap-around logic.
+//
+//  The consumer sleeps on a futex bumped by every produce, the producer only enters the kernel
+//  when the consumer is actually waiting. Linux only.
+//
+
+#ifndef SharedRing_h
+#define SharedRing_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHARED_RING_MAGIC 0x41455852 // "AEXR"
+
+// control block, first page of the shared memory object, data starts on the next page
+typedef struct {
+    uint32_t          magic;
+    int32_t           length;      // data bytes, whole pages
+    int32_t           sampleRate;  // of the PCM the producer writes
+    int32_t           head;        // producer only
+    int32_t           tail;        // consumer only
+    volatile int32_t  fillCount;
+    volatile int32_t  produced;    // futex word, bumped by every produce
+    volatile int32_t  waiting;     // consumer sleeping on produced
+} SharedRingHeader;
+
+typedef struct {
+    SharedRingHeader *header;
+    void             *buffer;      // data, mapped twice back to back
+    int32_t           length;
+    int               fd;
+    char              name[64];
+} SharedRing;
+
+/*!
+ * Create a ring
+ *
+ *  Creates (or truncates) the shared memory object and maps it. Called by the consumer,
+ *  producers attach with SharedRingOpen.
+ *
+ * @param ring Ring
+ * @param name Shared memory object name, e.g. "/audioex.0"
+ * @param length Data length in bytes, rounded up to whole pages
+ * @param sampleRate Rate of the PCM producers write
+ */
+bool SharedRingCreate(SharedRing *ring, const char *name, int32_t length, int32_t sampleRate);
+
+/*!
+ * Attach to an existing ring
+ */
+bool SharedRingOpen(SharedRing *ring, const char *name);
+
+/*!
+ * Unmap the ring, and remove the shared memory object if unlink is set
+ */
+void SharedRingClose(SharedRing *ring, bool unlink);
+
+/*!
+ * Block until at least the given number of bytes is ready for reading
+ *
+ * @param ring Ring
+ * @param bytes Bytes needed
+ * @param timeoutMs Maximum wait, negative waits forever
+ * @return true if the bytes are available
+ */
+bool SharedRingWait(SharedRing *ring, int32_t bytes, int timeoutMs);
+
+/*!
+ * Wake a consumer sleeping in SharedRingWait
+ */
+void SharedRingWake(SharedRing *ring);
+
+// Reading (consuming)
+
+/*!
+ * Access end of ring
+ *
+ * @param ring Ring
+ * @param availableBytes On output, the number of bytes ready for reading
+ * @return Pointer to the first bytes ready for reading, or NULL if the ring is empty
+ */
+static __inline__ __attribute__((always_inline)) void* SharedRingTail(SharedRing *ring, int32_t* availableBytes) {
+    *availableBytes = __atomic_load_n(&ring->header->fillCount, __ATOMIC_ACQUIRE);
+    if ( *availableBytes == 0 ) return NULL;
+    return (void*)((char*)ring->buffer + ring->header->tail);
+}
+
+/*!
+ * Consume bytes in ring
+ *
+ *  This frees up the just-read bytes, ready for writing again.
+ */
+static __inline__ __attribute__((always_inline)) void SharedRingConsume(SharedRing *ring, int32_t amount) {
+    ring->header->tail = (ring->header->tail + amount) % ring->length;
+    __atomic_fetch_sub(&ring->header->fillCount, amount, __ATOMIC_SEQ_CST);
+}
+
+// Writing (producing)
+
+/*!
+ * Access front of ring
+ *
+ * @param ring Ring
+ * @param availableBytes On output, the number of bytes ready for writing
+ * @return Pointer to the first bytes ready for writing, or NULL if the ring is full
+ */
+static __inline__ __attribute__((always_inline)) void* SharedRingHead(SharedRing *ring, int32_t* availableBytes) {
+    *availableBytes = ring->length - __atomic_load_n(&ring->header->fillCount, __ATOMIC_ACQUIRE);
+    if ( *availableBytes == 0 ) return NULL;
+    return (void*)((char*)ring->buffer + ring->header->head);
+}
+
+/*!
+ * Produce bytes in ring
+ *
+ *  This marks the given section of the ring ready for reading and wakes a waiting consumer.
+ */
+static __inline__ __attribute__((always_inline)) void SharedRingProduce(SharedRing *ring, int32_t amount) {
+    ring->header->head = (ring->header->head + amount) % ring->length;
+    __atomic_fetch_add(&ring->header->fillCount, amount, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&ring->header->produced, 1, __ATOMIC_SEQ_CST);
+    if ( __atomic_load_n(&ring->header->waiting, __ATOMIC_SEQ_CST) ) SharedRingWake(ring);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+//
+// audioexd, local decode daemon
+//
+// one shared memory ring per producer (/audioex.0, /audioex.1, ...), one decoder thread per ring
+// producers write PCM in the decoder's SAMPLE format straight into the mapped ring, protocol rate
+// blocks are decoded in place without copies, other rates go through the resampler (float builds)
+//
+//   audioexd [-n rings] [-r rate] [-s seconds]     decode, codes and messages are printed one per line
+//   audioexd -p ring < pcm                           feed raw PCM from stdin into a ring
+//
+// Linux only, e.g.:
+//   gcc -O2 -c SharedRing.c ../Classes/*_rs.c ../Classes/crc8.c
+//   g++ -O2 -pthread -I../Classes audioexd.cpp ../Classes/AudioEx.cpp SharedRing.o *_rs.o crc8.o -o audioexd -lrt
+//
+
+#include "AudioEx.h"
+#include "SharedRing.h"
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define RING_NAME "/audioex.%i"
+#define RING_MAX 64
+#define RING_SECONDS 2.0 // buffered audio per producer
+#define RING_WAIT_MS 500 // wakeups to check for shutdown
+
+static volatile sig_atomic_t running = 1;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    int index;
+    SharedRing ring;
+    pthread_t thread;
+} DECODER;
+
+static void stop(int)
+{
+    running = 0;
+}
+
+static void* decode(void *arg)
+{
+    DECODER *decoder = (DECODER *)arg;
+    SharedRing *ring = &decoder->ring;
+    AudioEx *audio_ex = new AudioEx(ring->header->sampleRate);
+
+    // protocol rate blocks are handed to gft where they lie, the ring's mirror keeps them contiguous
+    bool direct = ring->header->sampleRate == PROTOCOL_SAMPLE_RATE;
+    const int32_t block_bytes = AudioEx::SAMPLING_LENGTH * sizeof(SAMPLE);
+
+    while (running)
+    {
+        if (!SharedRingWait(ring, block_bytes, RING_WAIT_MS)) continue;
+
+        int32_t available = 0;
+        SAMPLE *samples = (SAMPLE *)SharedRingTail(ring, &available);
+        int count = available / sizeof(SAMPLE);
+        if (direct)
+        {
+            // gft windows the block in place, it's ours until consumed
+            count = AudioEx::SAMPLING_LENGTH;
+            audio_ex->gft(samples);
+        }
+        else
+        {
+#ifdef FIXED_POINT_ENABLED
+            count = 0;
+#else
+            audio_ex->process(samples, count);
+#endif
+        }
+        SharedRingConsume(ring, count * sizeof(SAMPLE));
+
+        if (audio_ex->result > 0 || audio_ex->message_len > 0)
+        {
+            pthread_mutex_lock(&output_lock);
+            if (audio_ex->result > 0) printf("%i code 0x%08X\n", decoder->index, audio_ex->result);
+            if (audio_ex->message_len > 0)
+            {
+                printf("%i message ", decoder->index);
+                for (int i=0; i<audio_ex->message_len; i++) printf("%02X", audio_ex->message[i]);
+                printf("\n");
+            }
+            fflush(stdout);
+            pthread_mutex_unlock(&output_lock);
+            audio_ex->result = 0;
+            audio_ex->message_len = 0;
+        }
+    }
+
+    delete audio_ex;
+    return NULL;
+}
+
+static int produce(int index)
+{
+    char name[64];
+    snprintf(name, sizeof name, RING_NAME, index);
+
+    SharedRing ring;
+    if (!SharedRingOpen(&ring, name)) return 1;
+
+    // read stdin straight into the ring
+    for (;;)
+    {
+        int32_t space = 0;
+        void *head = SharedRingHead(&ring, &space);
+        if (head == NULL)
+        {
+            usleep(1000);
+            continue;
+        }
+        space -= space % sizeof(SAMPLE);
+        ssize_t n = read(STDIN_FILENO, head, space);
+        if (n <= 0) break;
+        n -= n % sizeof(SAMPLE); // a split sample is dropped
+        SharedRingProduce(&ring, (int32_t)n);
+    }
+
+    SharedRingClose(&ring, false);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int rings = 1;
+    int rate = PROTOCOL_SAMPLE_RATE;
+    float seconds = RING_SECONDS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:s:p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': rings = atoi(optarg); break;
+            case 'r': rate = atoi(optarg); break;
+            case 's': seconds = atof(optarg); break;
+            case 'p': return produce(atoi(optarg));
+            default:
+                fprintf(stderr, "usage: %s [-n rings] [-r rate] [-s seconds] | -p ring\n", argv[0]);
+                return 1;
+        }
+    }
+    if (rings < 1 || rings > RING_MAX)
+    {
+        fprintf(stderr, "[ERROR] 1-%i rings\n", RING_MAX);
+        return 1;
+    }
+#ifdef FIXED_POINT_ENABLED
+    if (rate != PROTOCOL_SAMPLE_RATE)
+    {
+        fprintf(stderr, "[ERROR] fixed-point builds take %i Hz only\n", PROTOCOL_SAMPLE_RATE);
+        return 1;
+    }
+#endif
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    static DECODER decoders[RING_MAX];
+    int32_t length = (int32_t)(seconds * rate) * sizeof(SAMPLE);
+    int started = 0;
+    for (int i=0; i<rings; i++)
+    {
+        char name[64];
+        snprintf(name, sizeof name, RING_NAME, i);
+        decoders[i].index = i;
+        if (!SharedRingCreate(&decoders[i].ring, name, length, rate)) break;
+        pthread_create(&decoders[i].thread, NULL, decode, &decoders[i]);
+        started++;
+    }
+
+    while (running && started == rings) pause();
+    running = 0;
+
+    for (int i=0; i<started; i++)
+    {
+        SharedRingWake(&decoders[i].ring);
+        pthread_join(decoders[i].thread, NULL);
+        SharedRingClose(&decoders[i].ring, true);
+    }
+
+    return started == rings ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+//
+// audioexfixedcmp, decodes a reference corpus and compares the decisions of the float and fixed-point builds
+//
+// the corpus is generated from a fixed seed: each profile at three noise and three amplitude levels, four
+// trials apart in alignment and carrier offset, the last one sending a message after its code. It is quantised
+// to int16 before decoding, so a float build sees exactly the samples a fixed-point build does
+//
+//   audioexfixedcmp -o decisions     writes the decisions of this build, case, block and code or message one per line
+//   audioexfixedcmp -c decisions     compares them with the decisions of another build, exits with 1 on any decision
+//                                    or block missing on either side
+//
+// e.g.:
+//   gcc -O2 -c ../Classes/*_rs.c ../Classes/crc8.c
+//   g++ -O2 -I../Classes audioexfixedcmp.cpp ../Classes/AudioEx.cpp *_rs.o crc8.o -o audioexfixedcmp
+//   g++ -O2 -DFIXED_POINT_ENABLED -I../Classes audioexfixedcmp.cpp ../Classes/AudioEx.cpp *_rs.o crc8.o -o audioexfixedcmp_q15
+//   ./audioexfixedcmp -o float.txt && ./audioexfixedcmp_q15 -c float.txt
+//
+
+#include "AudioEx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CORPUS_SEED 17
+#define CORPUS_RATE 44100.0
+#define DECISION_LEN 128
+#define DECISION_WHAT_LEN 64 // code or message
+#define DECISIONS_MAX 4096
+
+static const double noises[] = {0.005, 0.02, 0.05};
+static const double amplitudes[] = {0.003, 0.01, 0.05};
+static const double offsets[] = {0.0, 20.0, -30.0, 10.0}; // Hz, carrier offset of each trial
+static const char message[] = "fixed point";
+
+typedef struct {
+    char (*lines)[DECISION_LEN];
+    int len;
+    int sent, decoded; // codes and messages
+    int blocks;
+    double elapsed;
+} DECISIONS;
+
+// deterministic across builds and platforms, unlike the distributions of <random>
+static uint64_t rng_state = CORPUS_SEED;
+static uint32_t rng_next()
+{
+    rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static double rng_gauss()
+{
+    // Box-Muller, one of the pair
+    double u1 = (rng_next() + 1.0) / 4294967297.0;
+    double u2 = rng_next() / 4294967296.0;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static void decision(DECISIONS *d, const char *name, int noise, int amplitude, int trial, int block, const char *what)
+{
+    if (d->len == DECISIONS_MAX) return;
+    snprintf(d->lines[d->len++], DECISION_LEN, "%s n%.3f a%.3f t%i block %i %s",
+             name, noises[noise], amplitudes[amplitude], trial, block, what);
+}
+
+template <class PROFILE>
+static void signal_add(float x[], const int data[], int slots, double amplitude, double offset)
+{
+    // slots with the generator's half sine envelope, the carrier offset continues across them
+    const int len = AudioExT<PROFILE>::SIGNAL_GENERATOR_LEN;
+    double phase = 0.0;
+    for (int s=0; s<slots; s++)
+    {
+        double w = 2.0 * M_PI * (PROFILE::signal_freqs[data[s]] + offset) / CORPUS_RATE;
+        for (int n=0; n<len; n++) x[s*len+n] += amplitude * sin(M_PI / len * n) * sin(phase + w * n);
+        phase += w * len;
+    }
+}
+
+template <class PROFILE>
+static void corpus_run(const char *name, DECISIONS *d)
+{
+    typedef AudioExT<PROFILE> A;
+    const int slot_len = A::SIGNAL_GENERATOR_LEN;
+    const int tail = A::SAMPLING_LENGTH * A::SIGNAL_TEST_FRAME_LEN * 2;
+
+    for (int n=0; n<3; n++) for (int a=0; a<3; a++) for (int trial=0; trial<4; trial++)
+    {
+        A *audio_ex = new A(CORPUS_RATE);
+        unsigned int code = rng_next() | 1;
+        bool framed = trial == 3;
+
+        // silence to settle the noise floor, the code, the message, silence to flush the history
+        typename A::AUDIO_DATA code_data;
+        audio_ex->signal_generator_data_from_int(code, code_data);
+        static typename A::MESSAGE_DATA message_data;
+        int message_slots = framed ? audio_ex->signal_generator_data_from_bytes((const unsigned char *)message, sizeof message - 1, message_data) : 0;
+
+        int lead = A::SAMPLING_LENGTH * (20 + trial*3) + trial*41;
+        int len = lead + (A::FULL_SIGNAL_LEN + message_slots) * slot_len + tail;
+        len -= len % A::SAMPLING_LENGTH;
+        float *x = (float *)calloc(len, sizeof(float));
+        signal_add<PROFILE>(&x[lead], code_data, A::FULL_SIGNAL_LEN, amplitudes[a], offsets[trial]);
+        if (framed) signal_add<PROFILE>(&x[lead + A::FULL_SIGNAL_LEN*slot_len], message_data, message_slots, amplitudes[a], offsets[trial]);
+
+        // int16 capture
+        for (int i=0; i<len; i++)
+        {
+            double q = rint((x[i] + noises[n] * rng_gauss()) * 32768.0);
+            x[i] = (float)(q > 32767.0 ? 32767.0 : q < -32768.0 ? -32768.0 : q) / 32768.0f;
+        }
+
+        d->sent += framed ? 2 : 1;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int b=0; b<len/A::SAMPLING_LENGTH; b++)
+        {
+            SAMPLE samples[A::SAMPLING_LENGTH];
+            for (int i=0; i<A::SAMPLING_LENGTH; i++) samples[i] = sample_pack(x[b*A::SAMPLING_LENGTH+i]);
+            audio_ex->gft(samples);
+            d->blocks++;
+
+            char what[DECISION_WHAT_LEN];
+            if (audio_ex->result > 0)
+            {
+                snprintf(what, sizeof what, "code 0x%08X", audio_ex->result);
+                decision(d, name, n, a, trial, b, what);
+                if (audio_ex->result == code) d->decoded++;
+                audio_ex->result = 0;
+            }
+            if (audio_ex->message_len > 0)
+            {
+                int k = snprintf(what, sizeof what, "message ");
+                for (int i=0; i<audio_ex->message_len && k+2 < (int)sizeof what; i++) k += snprintf(&what[k], sizeof what - k, "%02X", audio_ex->message[i]);
+                decision(d, name, n, a, trial, b, what);
+                if (audio_ex->message_len == (int)sizeof message - 1 && memcmp(audio_ex->message, message, sizeof message - 1) == 0) d->decoded++;
+                audio_ex->message_len = 0;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        d->elapsed += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+        free(x);
+        delete audio_ex;
+    }
+}
+
+static int decision_compare(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+static int decisions_missing(DECISIONS *from, DECISIONS *in, const char *mark)
+{
+    // both sorted, lines of from without a match in in
+    int missing = 0;
+    for (int i=0, j=0; i<from->len; i++)
+    {
+        while (j < in->len && strcmp(in->lines[j], from->lines[i]) < 0) j++;
+        if (j < in->len && strcmp(in->lines[j], from->lines[i]) == 0) { j++; continue; }
+        fprintf(stderr, "%s %s\n", mark, from->lines[i]);
+        missing++;
+    }
+    return missing;
+}
+
+int main(int argc, char *argv[])
+{
+    bool compare = argc == 3 && strcmp(argv[1], "-c") == 0;
+    if (argc != 3 || (!compare && strcmp(argv[1], "-o") != 0))
+    {
+        fprintf(stderr, "usage: %s -o decisions | -c decisions\n", argv[0]);
+        return 1;
+    }
+
+    DECISIONS ours;
+    memset(&ours, 0, sizeof ours);
+    ours.lines = (char (*)[DECISION_LEN])calloc(DECISIONS_MAX, DECISION_LEN);
+
+    corpus_run<PROFILE_DEFAULT>("default", &ours);
+    corpus_run<PROFILE_FAST>("fast", &ours);
+    corpus_run<PROFILE_ROBUST>("robust", &ours);
+    corpus_run<PROFILE_WIDE>("wide", &ours);
+    corpus_run<PROFILE_FDM>("fdm", &ours);
+
+    fprintf(stderr, "%s build: %i blocks, %i decisions, %i of %i codes and messages sent decoded, %.2fus/block\n",
+            sizeof(SAMPLE) == 2 ? "fixed-point" : "float", ours.blocks, ours.len, ours.decoded, ours.sent, ours.elapsed * 1e6 / ours.blocks);
+
+    if (!compare)
+    {
+        FILE *file = fopen(argv[2], "w");
+        if (file == NULL)
+        {
+            fprintf(stderr, "[ERROR] can't write %s\n", argv[2]);
+            free(ours.lines);
+            return 1;
+        }
+        for (int i=0; i<ours.len; i++) fprintf(file, "%s\n", ours.lines[i]);
+        fclose(file);
+        free(ours.lines);
+        return 0;
+    }
+
+    FILE *file = fopen(argv[2], "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "[ERROR] can't read %s\n", argv[2]);
+        free(ours.lines);
+        return 1;
+    }
+    DECISIONS theirs;
+    memset(&theirs, 0, sizeof theirs);
+    theirs.lines = (char (*)[DECISION_LEN])calloc(DECISIONS_MAX, DECISION_LEN);
+    while (theirs.len < DECISIONS_MAX && fgets(theirs.lines[theirs.len], DECISION_LEN, file) != NULL)
+    {
+        theirs.lines[theirs.len][strcspn(theirs.lines[theirs.len], "\n")] = 0;
+        if (theirs.lines[theirs.len][0] != 0) theirs.len++;
+    }
+    fclose(file);
+
+    // decisions of the reference build missing here (<) and ours missing there (>)
+    qsort(ours.lines, ours.len, DECISION_LEN, decision_compare);
+    qsort(theirs.lines, theirs.len, DECISION_LEN, decision_compare);
+    int differ = decisions_missing(&theirs, &ours, "<") + decisions_missing(&ours, &theirs, ">");
+    fprintf(stderr, "%i decisions compared with %i in %s, %i differ\n", ours.len, theirs.len, argv[2], differ);
+
+    free(ours.lines);
+    free(theirs.lines);
+    return differ > 0 || ours.len == 0 ? 1 : 0;
+}
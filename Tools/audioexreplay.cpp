@@ -0,0 +1,105 @@
+//
+// audioexreplay, feeds a capture recording back through the decoder
+//
+// the recorded blocks and echo references go to gft in their original order, so a build with the
+// same flags reports exactly what the device reported, as fast as the decoder runs
+//
+//   audioexreplay capture.aexc     codes and messages with their block numbers, then a summary
+//   audioexreplay -k capture.aexc  keeps going past blocks the recorder dropped, the run is flagged non-deterministic
+//
+// a dropped block leaves the decoder state different from the device's, so by default the replay
+// stops at the first gap, and a run with gaps exits with 2 either way
+//
+// e.g.:
+//   gcc -O2 -c ../Classes/CaptureRecorder.c ../Classes/*_rs.c ../Classes/crc8.c
+//   g++ -O2 -pthread -I../Classes audioexreplay.cpp ../Classes/AudioEx.cpp CaptureRecorder.o *_rs.o crc8.o -o audioexreplay
+//
+
+#include "AudioEx.h"
+#include "CaptureRecorder.h"
+#include <string.h>
+#include <time.h>
+
+int main(int argc, char *argv[])
+{
+    bool keep_going = argc == 3 && strcmp(argv[1], "-k") == 0;
+    if (argc != 2 && !keep_going)
+    {
+        fprintf(stderr, "usage: %s [-k] capture\n", argv[0]);
+        return 1;
+    }
+    const char *path = argv[argc - 1];
+
+    CaptureReader reader;
+    if (!CaptureReaderOpen(&reader, path))
+    {
+        fprintf(stderr, "[ERROR] %s is not a capture recording\n", path);
+        return 1;
+    }
+    if (reader.header.sampleSize != sizeof(SAMPLE) || reader.header.blockLength != AudioEx::SAMPLING_LENGTH)
+    {
+        // FIXED_POINT_ENABLED and the profile have to match the recording build
+        fprintf(stderr, "[ERROR] recorded %i byte samples in blocks of %i, this build takes %i in blocks of %i\n",
+                reader.header.sampleSize, reader.header.blockLength, (int)sizeof(SAMPLE), AudioEx::SAMPLING_LENGTH);
+        CaptureReaderClose(&reader);
+        return 1;
+    }
+
+    AudioEx *audio_ex = new AudioEx(reader.header.sampleRate);
+    SAMPLE samples[AudioEx::SAMPLING_LENGTH];
+    Float32 echo[AudioEx::SAMPLING_LENGTH];
+    bool has_echo = false;
+    int32_t gap = 0;
+    int blocks = 0, gaps = 0, reports = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int status;
+    while ((status = CaptureReaderNext(&reader, samples, echo, &has_echo, &gap)) > 0)
+    {
+        if (gap > 0)
+        {
+            // the recorder fell behind, the decoder saw blocks this file doesn't have
+            printf("%i gap %i\n", blocks, gap);
+            gaps += gap;
+            if (!keep_going)
+            {
+                fprintf(stderr, "[ERROR] %i blocks missing before block %i, replay stops here (-k to keep going)\n", gap, blocks);
+                break;
+            }
+        }
+#ifdef ECHO_CANCEL_ENABLED
+        if (has_echo) audio_ex->echo_reference(echo);
+#endif
+        audio_ex->gft(samples);
+
+        if (audio_ex->result > 0)
+        {
+            printf("%i code 0x%08X\n", blocks, audio_ex->result);
+            audio_ex->result = 0;
+            reports++;
+        }
+        if (audio_ex->message_len > 0)
+        {
+            printf("%i message ", blocks);
+            for (int i=0; i<audio_ex->message_len; i++) printf("%02X", audio_ex->message[i]);
+            printf("\n");
+            audio_ex->message_len = 0;
+            reports++;
+        }
+        blocks++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    double duration = (double)blocks * AudioEx::SAMPLING_LENGTH / reader.header.sampleRate;
+    fprintf(stderr, "%i blocks, %.1fs of audio in %.3fs (%.0fx real time), %i reports, %i blocks missing%s%s\n",
+            blocks, duration, elapsed, elapsed > 0 ? duration / elapsed : 0, reports, gaps,
+            gaps > 0 && keep_going ? ", NON-DETERMINISTIC" : "", status < 0 ? ", damaged file" : "");
+
+    delete audio_ex;
+    CaptureReaderClose(&reader);
+    if (status < 0) return 1;
+    return gaps > 0 ? 2 : 0;
+}